@@ -1,11 +1,60 @@
 ﻿#include <GL/glew.h>
 #include <GL/freeglut.h>
+#define GLM_ENABLE_EXPERIMENTAL
+#define GLM_FORCE_INTRINSICS // SIMD kernels pick SSE2/AVX2 from GLM_ARCH
+#include <glm/glm.hpp>
+#include <glm/gtx/spline.hpp>
 #include <vector>
 #include <cmath>
 #include <algorithm>
 #include <map>
 #include <string>
 #include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cfloat>
+#include <cctype>
+#include <cstddef>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <bitset>
+#include <fstream>
+#include <type_traits>
+#include <atomic>
+#include <memory>
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <cerrno>
+#include <GL/glxew.h>
+#else
+#include <filesystem>
+#endif
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <GL/wglew.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 const float PI = 3.14159265358979323846f;
 
@@ -13,387 +62,5817 @@ const float PI = 3.14159265358979323846f;
 float playerX = 0.0f;
 float playerY = 0.0f;
 const float playerSize = 0.3f;
-float moveSpeed = 0.05f;
 int playerLives = 3;
 bool isPlayerAlive = true;
 bool isGameOver = false;
 
-// Bullet structure
+// Bullet trajectory (see "Bullet pool" below)
+enum TrajectoryKind : uint8_t {
+    TRAJ_LINEAR,
+    TRAJ_CIRCULAR,
+    TRAJ_SINE,
+    TRAJ_SPLINE,
+    TRAJ_HOMING,
+};
+
+struct TrajectoryParams {
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    int path = -1;
+};
+
+// Bullet structure: spawn description, stored by BulletPool
 struct Bullet {
     float x, y;
     // x, y direction vector (normalized)
     float vx = 0.0f;
     float vy = 0.0f;
     float speed = 0.07f;
-	bool isFromPlayer = true; // Distinguish player, enemy bullet
+    TrajectoryKind kind = TRAJ_LINEAR;
+    TrajectoryParams params;
+};
+
+// Running state of a bullet pattern (see "Bullet patterns" below).
+// Fixed size so an enemy stays a plain value.
+const int PATTERN_MAX_THREADS = 8;
+const int PATTERN_MAX_DEPTH = 8;
+
+// Registers an emitter can set; saved and restored around nested emitters
+struct PatternRegs {
+    float angle, speed;
+    int traj;          // TrajectoryKind of emitted bullets
+    float trajA, trajB; // Wave amplitude and frequency, orbit rate, path ticks per segment, or homing turn and ticks
+    int path;
+    float jitter;       // Radians of random spread per bullet
+};
+
+struct PatternThread {
+    uint32_t pc;
+    int wait;
+    PatternRegs regs;
+    int loopDepth, saveDepth;
+    uint32_t loopStart[PATTERN_MAX_DEPTH];
+    int loopRemaining[PATTERN_MAX_DEPTH];
+    PatternRegs saved[PATTERN_MAX_DEPTH];
+    bool done;
+};
+
+struct PatternState {
+    int pattern = -1; // -1: single aimed shot on a cooldown
+    int threadCount = 0;
+    PatternThread threads[PATTERN_MAX_THREADS];
 };
 
 // Enemy structure
 struct Enemy {
     float x, y;
+    float vx, vy; // Per tick
     float size;
     int health;
-    int shootCooldown;
+    int maxHealth; // At spawn, for the HP bar
+    int shootCooldown; // Ticks until the next aimed shot
+    int shootInterval; // Ticks between aimed shots, from the stage template or the tuning
     bool isAlive;
+    PatternState pattern;
 };
 
-// Store all bullets
-std::vector<Bullet> bullets;
+// Laser beam: a capsule of the given radius from its origin along angle.
+// Beams owned by an enemy follow it and end with it.
+const uint8_t BEAM_HITS_ENEMIES = 1;
+const uint8_t BEAM_HITS_PLAYER = 2;
+const uint8_t BEAM_CANCELS_BULLETS = 4; // Removes enemy bullets along its length
 
-Enemy enemy;
+struct Beam {
+    float x, y;
+    float angle;       // Radians, same convention as pattern angles
+    float sweep;       // Radians per tick
+    float length, radius;
+    int warmup;        // Ticks of harmless telegraph before it does anything
+    int ticksLeft;     // -1: held until removed
+    int damageTimer;
+    uint8_t flags;
+    uint32_t owner;    // Enemy handle, 0 for the player
+};
 
-// Handle key states
-std::map<unsigned char, bool> keyState;
+// ------------------
+// Snapshot streams
+// ------------------
+// Byte streams behind simulation snapshots (see "Snapshots" below). Values and
+// whole arrays are copied with memcpy, arrays prefixed by their element count;
+// only trivially copyable types go in, so a blob is flat and position independent.
+struct SnapshotWriter {
+    std::vector<uint8_t>& out;
 
-// Timer for player actions
-int playerFireCooldownMax = 10;
-int playerFireCooldown = 0;
-int respawnTimer = 0;
+    template <typename T>
+    void put(const T& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values must be plain data");
+        append(&v, sizeof(T));
+    }
+
+    template <typename T>
+    void putArray(const std::vector<T>& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values must be plain data");
+        put((uint32_t)v.size());
+        append(v.data(), v.size() * sizeof(T));
+    }
+
+    void append(const void* data, size_t bytes) {
+        const uint8_t* p = (const uint8_t*)data;
+        out.insert(out.end(), p, p + bytes);
+    }
+};
+
+struct SnapshotReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    template <typename T>
+    void get(T& v) { read(&v, sizeof(T)); }
 
-// Game constants
-const int RESPAWN_FRAMES = 60; // Respawn after 60 frames
-const int ENEMY_SHOOT_COOLDOWN = 50; // Enemy shoots every 50 frames
-const float BULLET_SIZE = 0.015f;
+    // Reuses the vector's capacity, so restoring into warm containers never allocates
+    template <typename T>
+    void getArray(std::vector<T>& v) {
+        uint32_t n = 0;
+        get(n);
+        if (!ok || (size_t)(end - p) < (size_t)n * sizeof(T)) { ok = false; return; }
+        v.resize(n);
+        if (n) memcpy(v.data(), p, (size_t)n * sizeof(T));
+        p += (size_t)n * sizeof(T);
+    }
 
-// Camera shake
-int shakeTimer = 0;
-float shakeManitude = 0.02f;
+    void read(void* dst, size_t bytes) {
+        if ((size_t)(end - p) < bytes) { ok = false; return; }
+        memcpy(dst, p, bytes);
+        p += bytes;
+    }
+};
 
 // ------------------
-// Vertex arrays
+// Slot map
 // ------------------
-GLfloat playerVertices[30];
-GLfloat squareVertices[8];
-GLfloat circleVertices[2 * (1 + 36 + 1) /*center + 36 segments + back to first point*/];
-GLfloat bossVertices[2*(1+36+10)];
+// Elements live densely packed for iteration; a handle stays valid across
+// swap-removes and goes stale (instead of aliasing) once its element is removed.
+// Handle layout: low 20 bits slot index, high 12 bits generation. 0 is never valid.
+typedef uint32_t Handle;
+const Handle INVALID_HANDLE = 0;
+const int HANDLE_INDEX_BITS = 20;
+const uint32_t HANDLE_INDEX_MASK = (1u << HANDLE_INDEX_BITS) - 1;
+const uint32_t HANDLE_GENERATION_MASK = (1u << (32 - HANDLE_INDEX_BITS)) - 1;
 
-// Initialize each centered at origin
-void initializeVA() {
+inline uint32_t handleIndex(Handle h) { return h & HANDLE_INDEX_MASK; }
+inline uint32_t handleGeneration(Handle h) { return h >> HANDLE_INDEX_BITS; }
+inline Handle makeHandle(uint32_t index, uint32_t generation) { return (generation << HANDLE_INDEX_BITS) | index; }
 
-    // Main body
-    playerVertices[0] = -0.05f; playerVertices[1] = -0.10f;
-    playerVertices[2] =  0.05f; playerVertices[3] = -0.10f;
-    playerVertices[4] =  0.05f; playerVertices[5] =  0.10f;
-    playerVertices[6] = -0.05f; playerVertices[7] =  0.10f;
+// Handle bookkeeping, separate from element storage so any dense layout can use it
+struct SlotIndex {
+    std::vector<uint32_t> slotToDense;
+    std::vector<uint32_t> denseToSlot;
+    std::vector<uint16_t> generation;
+    std::vector<uint32_t> freeSlots;
 
-    // Top triangle
-    playerVertices[8]  = -0.05f; playerVertices[9]  = 0.10f;
-    playerVertices[10] =  0.05f; playerVertices[11] = 0.10f;
-    playerVertices[12] =  0.0f;  playerVertices[13] = 0.20f;
+    // Registers an element appended at dense index size()
+    Handle insert() {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = (uint32_t)slotToDense.size();
+            slotToDense.push_back(0);
+            generation.push_back(1);
+        }
+        slotToDense[slot] = (uint32_t)denseToSlot.size();
+        denseToSlot.push_back(slot);
+        return makeHandle(slot, generation[slot]);
+    }
 
-    // Left engine
-    playerVertices[14] = -0.10f; playerVertices[15] = -0.05f;
-    playerVertices[16] = -0.05f; playerVertices[17] = -0.05f;
-    playerVertices[18] = -0.05f; playerVertices[19] =  0.05f;
-    playerVertices[20] = -0.10f; playerVertices[21] =  0.05f;
+    void insertBatch(size_t count) {
+        for (size_t i = 0; i < count; ++i) insert();
+    }
 
-    // Right engine
-    playerVertices[22] = 0.05f; playerVertices[23] = -0.05f;
-    playerVertices[24] = 0.10f; playerVertices[25] = -0.05f;
-    playerVertices[26] = 0.10f; playerVertices[27] =  0.05f;
-    playerVertices[28] = 0.05f; playerVertices[29] =  0.05f;
+    template <typename Writer>
+    void save(Writer& w) const {
+        w.putArray(slotToDense); w.putArray(denseToSlot); w.putArray(generation); w.putArray(freeSlots);
+    }
 
-    // ------------------
+    void load(SnapshotReader& r) {
+        r.getArray(slotToDense); r.getArray(denseToSlot); r.getArray(generation); r.getArray(freeSlots);
+    }
 
-    // Square
-    squareVertices[0] = -0.5f; squareVertices[1] = -0.5f;
-    squareVertices[2] = 0.5f;  squareVertices[3] = -0.5f;
-    squareVertices[4] = 0.5f;  squareVertices[5] = 0.5f;
-    squareVertices[6] = -0.5f; squareVertices[7] = 0.5f;
+    void reserve(size_t capacity) {
+        slotToDense.reserve(capacity);
+        denseToSlot.reserve(capacity);
+        generation.reserve(capacity);
+        freeSlots.reserve(capacity);
+    }
 
-    // Circle
-    circleVertices[0] = 0.0f; circleVertices[1] = 0.0f;
-    for (int i = 0; i < 36; ++i) {
-        float angle = 2.0f * PI * i / 36;
-        circleVertices[2 * (i + 1)] = cos(angle);
-        circleVertices[2 * (i + 1) + 1] = sin(angle);
+    // Returns the dense index of a live handle, or -1
+    int find(Handle h) const {
+        uint32_t slot = handleIndex(h);
+        if (slot >= generation.size() || generation[slot] != handleGeneration(h)) return -1;
+        return (int)slotToDense[slot];
     }
-    circleVertices[2 * (36 + 1)] = circleVertices[2];
-    circleVertices[2 * (36 + 1) + 1] = circleVertices[3];
 
-    // --- Boss: circle + star ---
-    bossVertices[0] = 0.0f; bossVertices[1] = 0.0f;
-    for(int i=0;i<36;i++){
-        float angle = 2*PI*i/36;
-        bossVertices[2*(i+1)] = cos(angle)*0.5f;
-        bossVertices[2*(i+1)+1] = sin(angle)*0.5f;
+    Handle handleAt(uint32_t dense) const {
+        uint32_t slot = denseToSlot[dense];
+        return makeHandle(slot, generation[slot]);
     }
-    float starOuter=1.0f, starInner=0.35f;
-    for(int i=0;i<5;i++){
-        float angleOuter = 2*PI*i/5 - PI/2;
-        float angleInner = angleOuter + PI/5;
-        bossVertices[2*(36+1 + i*2)]   = cos(angleOuter)*starOuter;
-        bossVertices[2*(36+1 + i*2)+1] = sin(angleOuter)*starOuter;
-        bossVertices[2*(36+1 + i*2+1)]   = cos(angleInner)*starInner;
-        bossVertices[2*(36+1 + i*2+1)+1] = sin(angleInner)*starInner;
+
+    // Frees the element at a dense index; the caller moves its last element into the hole
+    void removeAt(uint32_t dense) {
+        uint32_t slot = denseToSlot[dense];
+        uint32_t last = (uint32_t)denseToSlot.size() - 1;
+        uint32_t movedSlot = denseToSlot[last];
+        denseToSlot[dense] = movedSlot;
+        slotToDense[movedSlot] = dense;
+        denseToSlot.pop_back();
+
+        // Bump the generation so outstanding handles go stale; skip 0 to keep INVALID_HANDLE unique
+        generation[slot] = (uint16_t)((generation[slot] + 1) & HANDLE_GENERATION_MASK);
+        if (generation[slot] == 0) generation[slot] = 1;
+        freeSlots.push_back(slot);
     }
-}
 
-// ------------------
-// Basic drawing functions
-// ------------------
-void drawPlayer_(float size) {
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(2,GL_FLOAT,0,playerVertices);
-    glPushMatrix();
-    glScalef(size,size,1.0f);
-    glDrawArrays(GL_QUADS,0,4);
-    glDrawArrays(GL_TRIANGLES,4,3);
-    glDrawArrays(GL_QUADS,7,4);
-    glDrawArrays(GL_QUADS,11,4);
-    glPopMatrix();
-    glDisableClientState(GL_VERTEX_ARRAY);
-}
+    void clear() {
+        for (uint32_t slot : denseToSlot) {
+            generation[slot] = (uint16_t)((generation[slot] + 1) & HANDLE_GENERATION_MASK);
+            if (generation[slot] == 0) generation[slot] = 1;
+            freeSlots.push_back(slot);
+        }
+        denseToSlot.clear();
+    }
 
-void drawSquare(float size) {
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(2, GL_FLOAT, 0, squareVertices);
-    glPushMatrix();
-    glScalef(size, size, 1.0f);
-    glDrawArrays(GL_QUADS, 0, 4);
-    glPopMatrix();
-    glDisableClientState(GL_VERTEX_ARRAY);
-}
+    size_t size() const { return denseToSlot.size(); }
+};
 
-void drawCircle(float radius) {
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(2, GL_FLOAT, 0, circleVertices);
-    glPushMatrix();
-    glScalef(radius, radius, 1.0f);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 36 + 2);
-    glPopMatrix();
-    glDisableClientState(GL_VERTEX_ARRAY);
-}
+template <typename T>
+class SlotMap {
+public:
+    Handle insert(const T& value) {
+        if (index.size() >= HANDLE_INDEX_MASK) return INVALID_HANDLE;
+        dense.push_back(value);
+        return index.insert();
+    }
 
-void drawBoss(float radius){
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(2,GL_FLOAT,0,bossVertices);
-    glPushMatrix();
-    glScalef(radius,radius,1.0f);
-    glDrawArrays(GL_TRIANGLE_FAN,0,37);
-    glDrawArrays(GL_TRIANGLE_FAN,37,10);
-    glPopMatrix();
-    glDisableClientState(GL_VERTEX_ARRAY);
-}
+    // Appends count default elements with a single resize and returns the dense index
+    // of the first, for callers that fill a whole batch in place
+    size_t insertBatch(size_t count) {
+        size_t first = dense.size();
+        count = std::min(count, (size_t)HANDLE_INDEX_MASK - first);
+        dense.resize(first + count);
+        index.insertBatch(count);
+        return first;
+    }
+
+    void reserve(size_t capacity) {
+        dense.reserve(capacity);
+        index.reserve(capacity);
+    }
+
+    T* get(Handle h) {
+        int i = index.find(h);
+        return i < 0 ? nullptr : &dense[i];
+    }
+
+    bool contains(Handle h) const { return index.find(h) >= 0; }
+
+    void remove(Handle h) {
+        int i = index.find(h);
+        if (i >= 0) removeAt(i);
+    }
+
+    // Swap-remove by dense position: the last element moves into i
+    void removeAt(size_t i) {
+        index.removeAt((uint32_t)i);
+        if (i + 1 != dense.size()) dense[i] = std::move(dense.back());
+        dense.pop_back();
+    }
+
+    template <typename Pred>
+    void removeIf(Pred pred) {
+        for (size_t i = 0; i < dense.size();) {
+            if (pred(dense[i])) removeAt(i);
+            else ++i;
+        }
+    }
+
+    void clear() {
+        index.clear();
+        dense.clear();
+    }
+
+    Handle handleAt(size_t i) const { return index.handleAt((uint32_t)i); }
+
+    template <typename Writer>
+    void save(Writer& w) const { index.save(w); w.putArray(dense); }
+    void load(SnapshotReader& r) { index.load(r); r.getArray(dense); }
+
+    T& operator[](size_t i) { return dense[i]; }
+    const T& operator[](size_t i) const { return dense[i]; }
+    size_t size() const { return dense.size(); }
+    bool empty() const { return dense.empty(); }
+    typename std::vector<T>::iterator begin() { return dense.begin(); }
+    typename std::vector<T>::iterator end() { return dense.end(); }
 
+private:
+    std::vector<T> dense;
+    SlotIndex index;
+};
 
 // ------------------
-// Objects drawing functions
+// Bullet pool
 // ------------------
-void drawPlayer() {
-    if (!isPlayerAlive) return;
+// Bullets don't integrate their motion. Each one keeps its spawn tick and a
+// trajectory, and positions are evaluated in closed form as a function of time
+// only when something needs them (collision, drawing), for any tick. The tick a
+// bullet leaves the screen is solved at spawn, so culling never touches positions.
+//   LINEAR   : p0 + v * age
+//   CIRCULAR : spiral around p0, radius a * age, angle b + c * age
+//   SINE     : p0 + v * age + n * a * sin(b * age + c), n = unit normal of v
+//   SPLINE   : p0 + rotate(cos a, sin b) * Catmull-Rom path, c ticks per segment
+//   HOMING   : LINEAR, re-anchored every tick by steer: the velocity turns toward
+//              a target by at most the angle (cos a, sin b), for c more ticks
+const int BULLET_MAX_LIFETIME = 60 * 60; // Ticks, for bullets that never leave the screen
+const uint8_t BULLET_GRAZED = 1;       // Already counted as a graze
+const float BULLET_CULL_BOUND = 1.1f;
 
-    glPushMatrix();
-    glTranslatef(playerX, playerY, 0.0f);
-    glColor3f(0.0f, 1.0f, 0.0f);
-    drawPlayer_(playerSize);
-    glPopMatrix();
+struct TrajectoryPath {
+    std::string name;
+    std::vector<glm::vec2> points; // Relative to the spawn point, for a bullet fired downwards
+};
+
+std::vector<TrajectoryPath> trajectoryPaths;
+
+// Tick count of the simulation, the time base of every trajectory
+int simTick = 0;
+
+inline bool isPiecewiseLinear(uint8_t kind) { return kind == TRAJ_LINEAR || kind == TRAJ_HOMING; }
+
+// Off: every batch kernel runs its scalar loop, the reference the SIMD paths have
+// to match bit for bit (see --verify-backends)
+bool simdKernels = true;
+
+// Turns each velocity toward (tx, ty) by at most the angle whose cosine and sine are
+// (cosMax, sinMax), keeping its length. Directions are normalized with an exact
+// sqrt and divide, never rsqrt: its precision differs between CPUs, and the SIMD
+// lanes have to match the scalar loop bit for bit. The clamp rotates by the limit
+// angle instead of going through atan2.
+void steerVelocities(const float* px, const float* py, float* vx, float* vy, const float* cosMax, const float* sinMax,
+                     size_t n, float tx, float ty) {
+    const float tiny = 1e-20f; // Keeps the divide finite on a bullet sitting on the target
+    size_t i = 0;
+
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    const __m256 vtx = _mm256_set1_ps(tx), vty = _mm256_set1_ps(ty);
+    const __m256 vtiny = _mm256_set1_ps(tiny), one = _mm256_set1_ps(1.0f);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (; simdKernels && i + 8 <= n; i += 8) {
+        __m256 dx = _mm256_sub_ps(vtx, _mm256_loadu_ps(px + i));
+        __m256 dy = _mm256_sub_ps(vty, _mm256_loadu_ps(py + i));
+        __m256 dsq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), vtiny);
+        __m256 dr = _mm256_div_ps(one, _mm256_sqrt_ps(dsq));
+        dx = _mm256_mul_ps(dx, dr);
+        dy = _mm256_mul_ps(dy, dr);
+
+        __m256 ux = _mm256_loadu_ps(vx + i), uy = _mm256_loadu_ps(vy + i);
+        __m256 vsq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ux, ux), _mm256_mul_ps(uy, uy)), vtiny);
+        __m256 vr = _mm256_div_ps(one, _mm256_sqrt_ps(vsq));
+        __m256 speed = _mm256_mul_ps(vsq, vr);
+        ux = _mm256_mul_ps(ux, vr);
+        uy = _mm256_mul_ps(uy, vr);
+
+        // Within the limit: face the target. Otherwise rotate by the limit, toward the target's side
+        __m256 c = _mm256_loadu_ps(cosMax + i);
+        __m256 cosAngle = _mm256_add_ps(_mm256_mul_ps(ux, dx), _mm256_mul_ps(uy, dy));
+        __m256 cross = _mm256_sub_ps(_mm256_mul_ps(ux, dy), _mm256_mul_ps(uy, dx));
+        __m256 sn = _mm256_xor_ps(_mm256_loadu_ps(sinMax + i), _mm256_and_ps(cross, signMask));
+        __m256 rx = _mm256_sub_ps(_mm256_mul_ps(ux, c), _mm256_mul_ps(uy, sn));
+        __m256 ry = _mm256_add_ps(_mm256_mul_ps(uy, c), _mm256_mul_ps(ux, sn));
+        __m256 within = _mm256_cmp_ps(cosAngle, c, _CMP_GE_OQ);
+        _mm256_storeu_ps(vx + i, _mm256_mul_ps(_mm256_blendv_ps(rx, dx, within), speed));
+        _mm256_storeu_ps(vy + i, _mm256_mul_ps(_mm256_blendv_ps(ry, dy, within), speed));
+    }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 vtx = _mm_set1_ps(tx), vty = _mm_set1_ps(ty);
+    const __m128 vtiny = _mm_set1_ps(tiny), one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (; simdKernels && i + 4 <= n; i += 4) {
+        __m128 dx = _mm_sub_ps(vtx, _mm_loadu_ps(px + i));
+        __m128 dy = _mm_sub_ps(vty, _mm_loadu_ps(py + i));
+        __m128 dsq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), vtiny);
+        __m128 dr = _mm_div_ps(one, _mm_sqrt_ps(dsq));
+        dx = _mm_mul_ps(dx, dr);
+        dy = _mm_mul_ps(dy, dr);
+
+        __m128 ux = _mm_loadu_ps(vx + i), uy = _mm_loadu_ps(vy + i);
+        __m128 vsq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, ux), _mm_mul_ps(uy, uy)), vtiny);
+        __m128 vr = _mm_div_ps(one, _mm_sqrt_ps(vsq));
+        __m128 speed = _mm_mul_ps(vsq, vr);
+        ux = _mm_mul_ps(ux, vr);
+        uy = _mm_mul_ps(uy, vr);
+
+        __m128 c = _mm_loadu_ps(cosMax + i);
+        __m128 cosAngle = _mm_add_ps(_mm_mul_ps(ux, dx), _mm_mul_ps(uy, dy));
+        __m128 cross = _mm_sub_ps(_mm_mul_ps(ux, dy), _mm_mul_ps(uy, dx));
+        __m128 sn = _mm_xor_ps(_mm_loadu_ps(sinMax + i), _mm_and_ps(cross, signMask));
+        __m128 rx = _mm_sub_ps(_mm_mul_ps(ux, c), _mm_mul_ps(uy, sn));
+        __m128 ry = _mm_add_ps(_mm_mul_ps(uy, c), _mm_mul_ps(ux, sn));
+        __m128 within = _mm_cmpge_ps(cosAngle, c);
+        __m128 nx = _mm_or_ps(_mm_and_ps(within, dx), _mm_andnot_ps(within, rx));
+        __m128 ny = _mm_or_ps(_mm_and_ps(within, dy), _mm_andnot_ps(within, ry));
+        _mm_storeu_ps(vx + i, _mm_mul_ps(nx, speed));
+        _mm_storeu_ps(vy + i, _mm_mul_ps(ny, speed));
+    }
+#endif
+
+    // Scalar fallback and tail
+    for (; i < n; ++i) {
+        float dx = tx - px[i], dy = ty - py[i];
+        float dr = 1.0f / std::sqrt(dx * dx + dy * dy + tiny);
+        dx *= dr; dy *= dr;
+        float vsq = vx[i] * vx[i] + vy[i] * vy[i] + tiny;
+        float vr = 1.0f / std::sqrt(vsq);
+        float speed = vsq * vr;
+        float ux = vx[i] * vr, uy = vy[i] * vr;
+
+        float c = cosMax[i];
+        float sn = ux * dy - uy * dx < 0.0f ? -sinMax[i] : sinMax[i];
+        if (ux * dx + uy * dy >= c) { ux = dx; uy = dy; }
+        else {
+            float rx = ux * c - uy * sn;
+            uy = uy * c + ux * sn;
+            ux = rx;
+        }
+        vx[i] = ux * speed;
+        vy[i] = uy * speed;
+    }
 }
 
-void drawEnemy() {
-    if (!enemy.isAlive) return;
+class BulletPool {
+public:
+    // Evaluated position, valid for positionTick
+    std::vector<float> x, y;
+    // Trajectory
+    std::vector<float> x0, y0;
+    std::vector<float> vx, vy; // Velocity per tick
+    std::vector<int> spawnTick, deathTick;
+    std::vector<uint8_t> kind;
+    std::vector<TrajectoryParams> params;
+    // Gameplay state
+    std::vector<uint8_t> flags; // BULLET_* bits, cleared on spawn
 
-    glPushMatrix();
-    glTranslatef(enemy.x, enemy.y, 0.0f);
-    glColor3f(0.6f, 0.2f, 0.8f);
-    drawBoss(enemy.size);
-    glPopMatrix();    
-    
-    // HP bar
-    float barW = 0.2f;
-    float barH = 0.02f;
-    float hpRatio = std::max(0.0f, (float)enemy.health / 10.0f);
+    int positionTick = -1;
+    size_t limit = HANDLE_INDEX_MASK; // Most bullets alive at once; spawns past it are dropped
 
-    // Background
-    glColor3f(0.3f, 0.3f, 0.3f);
-    glBegin(GL_QUADS);
-    glVertex2f(enemy.x - barW / 2, enemy.y + enemy.size + 0.03f);
-    glVertex2f(enemy.x + barW / 2, enemy.y + enemy.size + 0.03f);
-    glVertex2f(enemy.x + barW / 2, enemy.y + enemy.size + 0.03f + barH);
-    glVertex2f(enemy.x - barW / 2, enemy.y + enemy.size + 0.03f + barH);
-    glEnd();
-    
-    // Bar
-    glColor3f(1.0f - hpRatio, hpRatio, 0.0f);
-    glBegin(GL_QUADS);
-    glVertex2f(enemy.x - barW / 2, enemy.y + enemy.size + 0.03f);
-    glVertex2f(enemy.x - barW / 2 + barW * hpRatio, enemy.y + enemy.size + 0.03f);
-    glVertex2f(enemy.x - barW / 2 + barW * hpRatio, enemy.y + enemy.size + 0.03f + barH);
-    glVertex2f(enemy.x - barW / 2, enemy.y + enemy.size + 0.03f + barH);
-    glEnd();
+    Handle insert(const Bullet& b) {
+        size_t i = insertBatch(1);
+        if (i == size()) return INVALID_HANDLE;
+        x0[i] = b.x; y0[i] = b.y;
+        vx[i] = b.vx * b.speed; vy[i] = b.vy * b.speed;
+        kind[i] = b.kind;
+        params[i] = b.params;
+        finishBatch(i, 1);
+        return index.handleAt((uint32_t)i);
+    }
+
+    // Appends count bullets and returns the dense index of the first. The caller
+    // fills x0, y0, vx, vy, kind and params in place, then calls finishBatch.
+    size_t insertBatch(size_t count) {
+        size_t first = size();
+        count = first < limit ? std::min(count, limit - first) : 0;
+        size_t n = first + count;
+        x.resize(n); y.resize(n); x0.resize(n); y0.resize(n); vx.resize(n); vy.resize(n);
+        spawnTick.resize(n); deathTick.resize(n); kind.resize(n); params.resize(n); flags.resize(n);
+        index.insertBatch(count);
+        return first;
+    }
+
+    void finishBatch(size_t first, size_t count) {
+        for (size_t i = first; i < first + count; ++i) {
+            spawnTick[i] = simTick;
+            deathTick[i] = simTick + lifetime(i);
+            x[i] = x0[i];
+            y[i] = y0[i];
+            flags[i] = 0;
+            if (!isPiecewiseLinear(kind[i])) nonLinearCount++;
+            if (kind[i] == TRAJ_HOMING) homingCount++;
+        }
+        positionTick = -1;
+    }
+
+    // Swap-remove: the last bullet moves into i
+    void removeAt(size_t i) {
+        if (!isPiecewiseLinear(kind[i])) nonLinearCount--;
+        if (kind[i] == TRAJ_HOMING) homingCount--;
+        index.removeAt((uint32_t)i);
+        size_t last = size() - 1;
+        if (i != last) {
+            x[i] = x[last]; y[i] = y[last]; x0[i] = x0[last]; y0[i] = y0[last];
+            vx[i] = vx[last]; vy[i] = vy[last];
+            spawnTick[i] = spawnTick[last]; deathTick[i] = deathTick[last];
+            kind[i] = kind[last]; params[i] = params[last]; flags[i] = flags[last];
+        }
+        x.pop_back(); y.pop_back(); x0.pop_back(); y0.pop_back(); vx.pop_back(); vy.pop_back();
+        spawnTick.pop_back(); deathTick.pop_back(); kind.pop_back(); params.pop_back(); flags.pop_back();
+    }
+
+    void removeExpired(int tick) {
+        for (size_t i = 0; i < size();) {
+            if (deathTick[i] <= tick) removeAt(i);
+            else ++i;
+        }
+    }
+
+    // Positions of every bullet at tick. The linear pass is branch-free over
+    // plain arrays so it vectorizes; other trajectories are patched afterwards.
+    void evaluate(int tick) {
+        size_t n = size();
+        const int* t0 = spawnTick.data();
+        float* px = x.data();
+        float* py = y.data();
+        for (size_t i = 0; i < n; ++i) {
+            float age = (float)(tick - t0[i]);
+            px[i] = x0[i] + vx[i] * age;
+            py[i] = y0[i] + vy[i] * age;
+        }
+        if (nonLinearCount > 0) {
+            for (size_t i = 0; i < n; ++i) {
+                if (!isPiecewiseLinear(kind[i])) positionAt(i, tick, px[i], py[i]);
+            }
+        }
+        positionTick = tick;
+    }
+
+    void ensurePositions(int tick) {
+        if (positionTick != tick) evaluate(tick);
+    }
+
+    // Homing step for tick: gathers the homing bullets into contiguous arrays, turns
+    // them all with one steerVelocities call, and re-anchors each at its position
+    // so evaluate keeps treating it as a straight line. Once a bullet's steering
+    // ticks run out it becomes LINEAR and gets a real exit time.
+    void steer(int tick, float tx, float ty) {
+        if (homingCount == 0) return;
+
+        // Branch-free compaction of the homing indices
+        size_t n = size(), m = 0;
+        steerDense.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            steerDense[m] = (uint32_t)i;
+            m += kind[i] == TRAJ_HOMING;
+        }
+        steerDense.resize(m);
+        steerX.resize(m); steerY.resize(m); steerVx.resize(m); steerVy.resize(m);
+        steerCos.resize(m); steerSin.resize(m);
+        for (size_t k = 0; k < m; ++k) {
+            uint32_t i = steerDense[k];
+            float age = (float)(tick - spawnTick[i]);
+            steerX[k] = x0[i] + vx[i] * age;
+            steerY[k] = y0[i] + vy[i] * age;
+            steerVx[k] = vx[i];
+            steerVy[k] = vy[i];
+            steerCos[k] = params[i].a;
+            steerSin[k] = params[i].b;
+        }
+
+        steerVelocities(steerX.data(), steerY.data(), steerVx.data(), steerVy.data(), steerCos.data(), steerSin.data(), m, tx, ty);
+
+        for (size_t k = 0; k < m; ++k) {
+            uint32_t i = steerDense[k];
+            x0[i] = steerX[k]; y0[i] = steerY[k];
+            vx[i] = steerVx[k]; vy[i] = steerVy[k];
+            spawnTick[i] = tick;
+            if (--params[i].c <= 0.0f) {
+                kind[i] = TRAJ_LINEAR;
+                homingCount--;
+                deathTick[i] = tick + exitTime(x0[i], y0[i], vx[i], vy[i], 0.0f);
+            }
+        }
+        positionTick = -1;
+    }
+
+    void positionAt(size_t i, int tick, float& px, float& py) const {
+        float age = (float)(tick - spawnTick[i]);
+        const TrajectoryParams& p = params[i];
+        switch (kind[i]) {
+        case TRAJ_CIRCULAR: {
+            float r = p.a * age, angle = p.b + p.c * age;
+            px = x0[i] + r * std::cos(angle);
+            py = y0[i] + r * std::sin(angle);
+            break;
+        }
+        case TRAJ_SINE: {
+            float len = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+            float offset = len > 0.0f ? p.a * std::sin(p.b * age + p.c) / len : 0.0f;
+            px = x0[i] + vx[i] * age - vy[i] * offset;
+            py = y0[i] + vy[i] * age + vx[i] * offset;
+            break;
+        }
+        case TRAJ_SPLINE: {
+            glm::vec2 local = pathPoint(trajectoryPaths[p.path].points, age / p.c);
+            px = x0[i] + p.a * local.x - p.b * local.y;
+            py = y0[i] + p.b * local.x + p.a * local.y;
+            break;
+        }
+        default:
+            px = x0[i] + vx[i] * age;
+            py = y0[i] + vy[i] * age;
+            break;
+        }
+    }
+
+    void clear() {
+        index.clear();
+        x.clear(); y.clear(); x0.clear(); y0.clear(); vx.clear(); vy.clear();
+        spawnTick.clear(); deathTick.clear(); kind.clear(); params.clear(); flags.clear();
+        nonLinearCount = 0;
+        homingCount = 0;
+        positionTick = -1;
+    }
+
+    void reserve(size_t capacity) {
+        index.reserve(capacity);
+        x.reserve(capacity); y.reserve(capacity); x0.reserve(capacity); y0.reserve(capacity);
+        vx.reserve(capacity); vy.reserve(capacity);
+        spawnTick.reserve(capacity); deathTick.reserve(capacity);
+        kind.reserve(capacity); params.reserve(capacity); flags.reserve(capacity);
+    }
+
+    int find(Handle h) const { return index.find(h); }
+    Handle handleAt(size_t i) const { return index.handleAt((uint32_t)i); }
+    size_t size() const { return index.size(); }
+
+    // Every array in full, evaluated positions included; steer scratch is not state
+    template <typename Writer>
+    void save(Writer& w) const {
+        index.save(w);
+        w.putArray(x); w.putArray(y); w.putArray(x0); w.putArray(y0); w.putArray(vx); w.putArray(vy);
+        w.putArray(spawnTick); w.putArray(deathTick); w.putArray(kind); w.putArray(params); w.putArray(flags);
+        w.put(positionTick); w.put(nonLinearCount); w.put(homingCount);
+    }
+
+    void load(SnapshotReader& r) {
+        index.load(r);
+        r.getArray(x); r.getArray(y); r.getArray(x0); r.getArray(y0); r.getArray(vx); r.getArray(vy);
+        r.getArray(spawnTick); r.getArray(deathTick); r.getArray(kind); r.getArray(params); r.getArray(flags);
+        r.get(positionTick); r.get(nonLinearCount); r.get(homingCount);
+    }
+
+    static glm::vec2 pathPoint(const std::vector<glm::vec2>& pts, float s) {
+        int last = (int)pts.size() - 1;
+        if (last <= 0) return pts.empty() ? glm::vec2(0.0f) : pts[0];
+        int seg = std::min((int)s, last - 1);
+        float f = std::min(s - seg, 1.0f);
+        return glm::catmullRom(pts[std::max(seg - 1, 0)], pts[seg], pts[seg + 1], pts[std::min(seg + 2, last)], f);
+    }
+
+private:
+    SlotIndex index;
+    int nonLinearCount = 0; // Bullets evaluate has to patch
+    int homingCount = 0;
+
+    // steer scratch, SoA over the homing bullets only
+    std::vector<uint32_t> steerDense;
+    std::vector<float> steerX, steerY, steerVx, steerVy, steerCos, steerSin;
+
+    // Ticks until the bullet is out of the cull bounds for good
+    int lifetime(size_t i) const {
+        const TrajectoryParams& p = params[i];
+        switch (kind[i]) {
+        case TRAJ_LINEAR:
+            return exitTime(x0[i], y0[i], vx[i], vy[i], 0.0f);
+        case TRAJ_SINE:
+            return exitTime(x0[i], y0[i], vx[i], vy[i], std::abs(p.a));
+        case TRAJ_CIRCULAR: {
+            // Outside once the radius exceeds the distance to the farthest corner
+            if (p.a <= 0.0f) return BULLET_MAX_LIFETIME;
+            float far = std::sqrt(2.0f) * BULLET_CULL_BOUND + std::sqrt(x0[i] * x0[i] + y0[i] * y0[i]);
+            return std::min(BULLET_MAX_LIFETIME, (int)(far / p.a) + 1);
+        }
+        case TRAJ_SPLINE: {
+            int segments = std::max(1, (int)trajectoryPaths[p.path].points.size() - 1);
+            return std::min(BULLET_MAX_LIFETIME, (int)(segments * p.c) + 1);
+        }
+        case TRAJ_HOMING:
+            return BULLET_MAX_LIFETIME; // Replaced by steer when homing ends
+        }
+        return BULLET_MAX_LIFETIME;
+    }
+
+    // First tick n >= 1 at which p + v * n is outside the bounds grown by margin
+    static int exitTime(float px, float py, float vx, float vy, float margin) {
+        float bound = BULLET_CULL_BOUND + margin;
+        float t = (float)BULLET_MAX_LIFETIME;
+        if (vx > 0.0f) t = std::min(t, (bound - px) / vx);
+        if (vx < 0.0f) t = std::min(t, (-bound - px) / vx);
+        if (vy > 0.0f) t = std::min(t, (bound - py) / vy);
+        if (vy < 0.0f) t = std::min(t, (-bound - py) / vy);
+        return std::max(1, (int)std::floor(t) + 1);
+    }
+};
+
+// Player and enemy bullets never interact, so they are pooled separately
+BulletPool playerBullets;
+BulletPool enemyBullets;
+
+// Store all enemies
+SlotMap<Enemy> enemies;
+Handle bossHandle = INVALID_HANDLE;
+
+// Stage progress (see "Stage"): the spawn table is read from stageStartTick on
+int stageStartTick = 0;
+int stageCursor = 0; // Next spawn
+
+// Active lasers; the player's is held while its key is down
+SlotMap<Beam> beams;
+Handle playerBeam = INVALID_HANDLE;
+
+// Handle key states
+std::map<unsigned char, bool> keyState;
+
+// One tick of player input. The simulation reads these instead of keyState, so a
+// tick can be replayed (see "Rollback") or driven by something other than the keyboard.
+const uint8_t INPUT_UP = 1;
+const uint8_t INPUT_DOWN = 2;
+const uint8_t INPUT_LEFT = 4;
+const uint8_t INPUT_RIGHT = 8;
+const uint8_t INPUT_FIRE = 16;
+const uint8_t INPUT_LASER = 32;
+
+struct InputFrame {
+    uint8_t buttons = 0; // INPUT_* bits
+    uint8_t garbage = 0; // Versus: volleys sent to the opponent this tick
+};
+
+// Versus garbage: grazes and hits charge it, each volley sent costs GARBAGE_COST
+const int GARBAGE_COST = 30;
+const int GARBAGE_CHARGE_PER_HIT = 2;
+const int GARBAGE_VOLLEY_SIZE = 7;
+int garbageCharge = 0;
+
+// Timer for player actions
+int playerFireCooldown = 0;
+int respawnTimer = 0;
+
+// Gameplay tuning, loaded from a text file and hot-reloaded at tick boundaries.
+// Plain struct so the hot path only does field reads.
+struct Tuning {
+    int respawnFrames = 60;          // Respawn after 60 frames
+    int enemyShootCooldown = 50;     // Enemy shoots every 50 frames
+    float bulletSize = 0.015f;
+    float moveSpeed = 0.05f;
+    int playerFireCooldownMax = 10;
+    float playerBulletSpeed = 0.08f;
+    float enemyBulletSpeed = 0.04f;
+    float grazeRadius = 0.08f;       // Enemy bullets passing this close to the ship score a graze
+    float laserWidth = 0.02f;        // Player laser radius
+    int laserDamageInterval = 15;    // Ticks between player laser hits on the same beam
+    int enemyLaserWarmup = 45;       // Telegraph ticks before an enemy laser can hit
+
+    // Enemy setup, applied on the next spawn (start or reset)
+    float enemyX = 0.0f;
+    float enemyY = 0.6f;
+    float enemySize = 0.09f;
+    int enemyHealth = 10;
+    int enemyFirstShotDelay = 30;
+};
+
+Tuning tuning;
+
+// ------------------
+// Random numbers
+// ------------------
+// xoshiro128+ streams, one per system (shake, patterns, particles, bot, loopback,
+// background), so one system's draws never shift another's and nothing shares
+// hidden state: a stream belongs to whoever owns its system and takes no lock.
+// Streams are seeded from rngSeed (--seed) and their stream number via splitmix64.
+// Single draws step one generator. The batch fills step eight interleaved
+// generators together, one AVX2 register or two SSE2 ones, and produce the same
+// numbers on every path, consumed in whole groups of eight. Gaussian values sum
+// twelve uniforms (Irwin-Hall): plain float adds, so they replay bit for bit where
+// a libm log or sin might not. Method names follow glm/gtc/random, whose helpers
+// are built on std::rand and stay unused.
+const int RNG_LANES = 8;
+
+enum RngStream : uint64_t { RNG_SHAKE = 1, RNG_PATTERNS, RNG_PARTICLES, RNG_BOT, RNG_LOOPBACK, RNG_BACKGROUND };
+
+uint64_t rngSeed = 0x5eedf00dull;
+
+inline uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+struct Rng {
+    uint32_t s[4];
+    uint32_t lanes[4][RNG_LANES]; // Word k of batch generator j is lanes[k][j]
+
+    explicit Rng(uint64_t stream = 0) { seed(rngSeed, stream); }
+
+    void seed(uint64_t value, uint64_t stream) {
+        uint64_t x = value ^ (stream * 0xD1B54A32D192ED03ull);
+        for (int k = 0; k < 4; k += 2) {
+            uint64_t z = splitmix64(x);
+            s[k] = (uint32_t)z;
+            s[k + 1] = (uint32_t)(z >> 32);
+        }
+        for (int j = 0; j < RNG_LANES; ++j) {
+            for (int k = 0; k < 4; k += 2) {
+                uint64_t z = splitmix64(x);
+                lanes[k][j] = (uint32_t)z;
+                lanes[k + 1][j] = (uint32_t)(z >> 32);
+            }
+        }
+    }
+
+    uint32_t next() {
+        uint32_t result = s[0] + s[3];
+        uint32_t t = s[1] << 9;
+        s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = (s[3] << 11) | (s[3] >> 21);
+        return result;
+    }
+
+    // In [0, 1), 24 bits
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+    float linearRand(float lo, float hi) { return lo + (hi - lo) * uniform(); }
+    float gaussRand(float mean, float deviation) {
+        float sum = 0.0f;
+        for (int k = 0; k < 12; ++k) sum += uniform();
+        return mean + deviation * (sum - 6.0f);
+    }
+    glm::vec2 circularRand(float radius) {
+        float angle = uniform() * 2 * PI;
+        return glm::vec2(std::cos(angle), std::sin(angle)) * radius;
+    }
+
+    void fillUniform(float* out, size_t n, float lo, float hi) {
+        float u[RNG_LANES];
+        for (size_t i = 0; i < n; i += RNG_LANES) {
+            stepLanes(u);
+            size_t end = std::min(n - i, (size_t)RNG_LANES);
+            for (size_t k = 0; k < end; ++k) out[i + k] = lo + (hi - lo) * u[k];
+        }
+    }
+
+    void fillGauss(float* out, size_t n, float mean, float deviation) {
+        float u[RNG_LANES], sum[RNG_LANES];
+        for (size_t i = 0; i < n; i += RNG_LANES) {
+            for (float& v : sum) v = 0.0f;
+            for (int r = 0; r < 12; ++r) {
+                stepLanes(u);
+                for (int k = 0; k < RNG_LANES; ++k) sum[k] += u[k];
+            }
+            size_t end = std::min(n - i, (size_t)RNG_LANES);
+            for (size_t k = 0; k < end; ++k) out[i + k] = mean + deviation * (sum[k] - 6.0f);
+        }
+    }
+
+private:
+    // One step of every batch generator, as uniforms in [0, 1)
+    void stepLanes(float* u) {
+        int j = 0;
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+        if (simdKernels) {
+            __m256i s0 = _mm256_loadu_si256((const __m256i*)lanes[0]), s1 = _mm256_loadu_si256((const __m256i*)lanes[1]);
+            __m256i s2 = _mm256_loadu_si256((const __m256i*)lanes[2]), s3 = _mm256_loadu_si256((const __m256i*)lanes[3]);
+            __m256i result = _mm256_add_epi32(s0, s3);
+            __m256i t = _mm256_slli_epi32(s1, 9);
+            s2 = _mm256_xor_si256(s2, s0); s3 = _mm256_xor_si256(s3, s1);
+            s1 = _mm256_xor_si256(s1, s2); s0 = _mm256_xor_si256(s0, s3);
+            s2 = _mm256_xor_si256(s2, t);
+            s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+            _mm256_storeu_si256((__m256i*)lanes[0], s0); _mm256_storeu_si256((__m256i*)lanes[1], s1);
+            _mm256_storeu_si256((__m256i*)lanes[2], s2); _mm256_storeu_si256((__m256i*)lanes[3], s3);
+            __m256 v = _mm256_cvtepi32_ps(_mm256_srli_epi32(result, 8));
+            _mm256_storeu_ps(u, _mm256_mul_ps(v, _mm256_set1_ps(1.0f / 16777216.0f)));
+            j = RNG_LANES;
+        }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+        for (; simdKernels && j < RNG_LANES; j += 4) {
+            __m128i s0 = _mm_loadu_si128((const __m128i*)(lanes[0] + j)), s1 = _mm_loadu_si128((const __m128i*)(lanes[1] + j));
+            __m128i s2 = _mm_loadu_si128((const __m128i*)(lanes[2] + j)), s3 = _mm_loadu_si128((const __m128i*)(lanes[3] + j));
+            __m128i result = _mm_add_epi32(s0, s3);
+            __m128i t = _mm_slli_epi32(s1, 9);
+            s2 = _mm_xor_si128(s2, s0); s3 = _mm_xor_si128(s3, s1);
+            s1 = _mm_xor_si128(s1, s2); s0 = _mm_xor_si128(s0, s3);
+            s2 = _mm_xor_si128(s2, t);
+            s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+            _mm_storeu_si128((__m128i*)(lanes[0] + j), s0); _mm_storeu_si128((__m128i*)(lanes[1] + j), s1);
+            _mm_storeu_si128((__m128i*)(lanes[2] + j), s2); _mm_storeu_si128((__m128i*)(lanes[3] + j), s3);
+            __m128 v = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+            _mm_storeu_ps(u + j, _mm_mul_ps(v, _mm_set1_ps(1.0f / 16777216.0f)));
+        }
+#endif
+        // Scalar fallback
+        for (; j < RNG_LANES; ++j) {
+            uint32_t& s0 = lanes[0][j];
+            uint32_t& s1 = lanes[1][j];
+            uint32_t& s2 = lanes[2][j];
+            uint32_t& s3 = lanes[3][j];
+            uint32_t result = s0 + s3;
+            uint32_t t = s1 << 9;
+            s2 ^= s0; s3 ^= s1; s1 ^= s2; s0 ^= s3;
+            s2 ^= t;
+            s3 = (s3 << 11) | (s3 >> 21);
+            u[j] = (result >> 8) * (1.0f / 16777216.0f);
+        }
+    }
+};
+
+// Shake is visual only; the pattern stream is simulation state and goes into snapshots
+Rng shakeRng(RNG_SHAKE);
+Rng patternRng(RNG_PATTERNS);
+
+// ------------------
+// Tuning file
+// ------------------
+// "key = value" per line, '#' starts a comment. A file with any bad line or
+// out-of-range value is rejected as a whole, so a half-edited file never reaches the game.
+enum TuningRange {
+    TUNING_POSITIVE,     // > 0: sizes, speeds, health, intervals
+    TUNING_NON_NEGATIVE, // >= 0: delays and radii where 0 turns the thing off
+    TUNING_ON_FIELD,     // Within the playfield, [-1, 1]
+};
+
+struct TuningField {
+    const char* name;
+    int Tuning::* i;
+    float Tuning::* f;
+    TuningRange range;
+};
+
+const TuningField tuningFields[] = {
+    { "respawn_frames",           &Tuning::respawnFrames,         nullptr, TUNING_NON_NEGATIVE },
+    { "enemy_shoot_cooldown",     &Tuning::enemyShootCooldown,    nullptr, TUNING_POSITIVE },
+    { "bullet_size",              nullptr, &Tuning::bulletSize,            TUNING_POSITIVE },
+    { "move_speed",               nullptr, &Tuning::moveSpeed,             TUNING_POSITIVE },
+    { "player_fire_cooldown",     &Tuning::playerFireCooldownMax, nullptr, TUNING_POSITIVE },
+    { "player_bullet_speed",      nullptr, &Tuning::playerBulletSpeed,     TUNING_POSITIVE },
+    { "enemy_bullet_speed",       nullptr, &Tuning::enemyBulletSpeed,      TUNING_POSITIVE },
+    { "graze_radius",             nullptr, &Tuning::grazeRadius,           TUNING_NON_NEGATIVE },
+    { "laser_width",              nullptr, &Tuning::laserWidth,            TUNING_POSITIVE },
+    { "laser_damage_interval",    &Tuning::laserDamageInterval,   nullptr, TUNING_POSITIVE },
+    { "enemy_laser_warmup",       &Tuning::enemyLaserWarmup,      nullptr, TUNING_NON_NEGATIVE },
+    { "enemy_x",                  nullptr, &Tuning::enemyX,                TUNING_ON_FIELD },
+    { "enemy_y",                  nullptr, &Tuning::enemyY,                TUNING_ON_FIELD },
+    { "enemy_size",               nullptr, &Tuning::enemySize,             TUNING_POSITIVE },
+    { "enemy_health",             &Tuning::enemyHealth,           nullptr, TUNING_POSITIVE },
+    { "enemy_first_shot_delay",   &Tuning::enemyFirstShotDelay,   nullptr, TUNING_NON_NEGATIVE },
+};
+
+// Written so that NaN fails every range
+bool tuningInRange(TuningRange range, float value) {
+    switch (range) {
+    case TUNING_POSITIVE: return value > 0.0f;
+    case TUNING_NON_NEGATIVE: return value >= 0.0f;
+    default: return value >= -1.0f && value <= 1.0f;
+    }
+}
+
+const char* tuningRangeText(TuningRange range) {
+    switch (range) {
+    case TUNING_POSITIVE: return "> 0";
+    case TUNING_NON_NEGATIVE: return ">= 0";
+    default: return "in [-1, 1]";
+    }
+}
+
+std::string tuningPath = "tuning.txt";
+bool tuningChanged = false;
+
+#ifdef __linux__
+int tuningNotifyFd = -1;
+#else
+std::filesystem::file_time_type tuningWriteTime;
+int tuningPollCounter = 0;
+#endif
+
+// Parses into out, starting from defaults; returns false (and leaves out untouched) on any error
+bool parseTuning(const std::string& path, Tuning& out) {
+    std::ifstream file(path);
+    if (!file) return false;
+
+    Tuning parsed;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        size_t eq = line.find('=');
+        std::istringstream keyStream(line.substr(0, eq));
+        std::string key;
+        if (!(keyStream >> key)) continue; // Blank line
+
+        const TuningField* field = nullptr;
+        for (const auto& f : tuningFields) {
+            if (key == f.name) field = &f;
+        }
+        std::istringstream valueStream(eq == std::string::npos ? "" : line.substr(eq + 1));
+        std::string rest;
+        bool ok = field != nullptr;
+        float value = 0.0f;
+        if (ok && field->i) {
+            ok = (bool)(valueStream >> parsed.*(field->i));
+            value = (float)(parsed.*(field->i));
+        }
+        else if (ok) {
+            ok = (bool)(valueStream >> parsed.*(field->f));
+            value = parsed.*(field->f);
+        }
+        if (ok && (valueStream >> rest)) ok = false; // Trailing garbage
+
+        if (!ok) {
+            printf("Tuning: %s:%d: bad line \"%s\", keeping previous values\n", path.c_str(), lineNumber, line.c_str());
+            return false;
+        }
+        if (!tuningInRange(field->range, value)) {
+            printf("Tuning: %s:%d: %s must be %s, keeping previous values\n", path.c_str(), lineNumber, field->name, tuningRangeText(field->range));
+            return false;
+        }
+    }
+
+    out = parsed;
+    return true;
+}
+
+void watchTuning() {
+#ifdef __linux__
+    // Watch the directory: editors usually save by writing a new file and renaming it over the old one
+    tuningNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (tuningNotifyFd < 0) return;
+    size_t slash = tuningPath.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : tuningPath.substr(0, slash + 1);
+    if (inotify_add_watch(tuningNotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        close(tuningNotifyFd);
+        tuningNotifyFd = -1;
+    }
+#else
+    std::error_code ec;
+    tuningWriteTime = std::filesystem::last_write_time(tuningPath, ec);
+#endif
+}
+
+// Checks the watcher without blocking; sets tuningChanged when the file was rewritten
+void pollTuningWatch() {
+#ifdef __linux__
+    if (tuningNotifyFd < 0) return;
+    size_t slash = tuningPath.find_last_of('/');
+    std::string name = slash == std::string::npos ? tuningPath : tuningPath.substr(slash + 1);
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t len;
+    while ((len = read(tuningNotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + len;) {
+            const inotify_event* event = (const inotify_event*)p;
+            if (event->len > 0 && name == event->name) tuningChanged = true;
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+#else
+    // No inotify: check the modification time twice a second
+    if (++tuningPollCounter < 30) return;
+    tuningPollCounter = 0;
+    std::error_code ec;
+    auto writeTime = std::filesystem::last_write_time(tuningPath, ec);
+    if (!ec && writeTime != tuningWriteTime) {
+        tuningWriteTime = writeTime;
+        tuningChanged = true;
+    }
+#endif
+}
+
+void loadTuning() {
+    if (parseTuning(tuningPath, tuning)) printf("Tuning: loaded %s\n", tuningPath.c_str());
+    watchTuning();
+}
+
+// Tick boundary: a changed file replaces the whole struct at once
+void applyTuningChanges() {
+    pollTuningWatch();
+    if (!tuningChanged) return;
+    tuningChanged = false;
+
+    Tuning reloaded;
+    if (parseTuning(tuningPath, reloaded)) {
+        tuning = reloaded;
+        printf("Tuning: reloaded %s\n", tuningPath.c_str());
+    }
+}
+
+// ------------------
+// Tracing
+// ------------------
+// Scoped timeline events, written out as Chrome trace-event JSON (open in Perfetto
+// or chrome://tracing). Every thread appends finished scopes to its own buffer:
+// only the owner writes, and the count is published with a release store, so
+// recording takes no lock. Buffers are allocated on a thread's first event and
+// outlive it, and a new session (T, or --trace) resets each one lazily from its
+// own thread. Timestamps are raw TSC ticks, scaled to microseconds against
+// steady_clock over the whole session when the file is written.
+//
+// Build with /D TRACING=0 to compile every TRACE_SCOPE out. Compiled in and idle,
+// a scope costs one predictable branch on entry and one on exit.
+#ifndef TRACING
+#define TRACING 1
+#endif
+
+std::string tracePath = "trace.json";
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if TRACING
+const uint32_t TRACE_BUFFER_EVENTS = 1 << 17; // Per thread, ~3 MB; later events are dropped
+
+struct TraceEvent {
+    const char* name; // String literal
+    uint64_t begin, end;
+};
+
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+    std::atomic<uint32_t> count{ 0 };
+    std::atomic<uint32_t> dropped{ 0 };
+    std::atomic<uint32_t> session{ 0 };
+    std::atomic<bool> owned{ true };  // False once the thread exits
+    const char* threadName = "thread";
+};
+
+struct Tracer {
+    std::atomic<bool> recording{ false };
+    std::atomic<uint32_t> session{ 0 };
+    uint64_t startTicks = 0;
+    std::chrono::steady_clock::time_point startTime;
+    std::mutex mutex; // Guards buffers; taken once per thread, never per event
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+} tracer;
+
+uint64_t traceNow() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Hands the buffer back for reuse when its thread exits
+struct TraceThread {
+    TraceBuffer* buffer = nullptr;
+    const char* name = "thread";
+    ~TraceThread() { if (buffer) buffer->owned.store(false); }
+};
+thread_local TraceThread traceThread;
+
+// A buffer left by an exited thread, unless it still holds this session's events
+TraceBuffer* acquireTraceBuffer() {
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    uint32_t session = tracer.session.load();
+    TraceBuffer* buffer = nullptr;
+    for (auto& b : tracer.buffers) {
+        if (b->owned.load() || (b->session.load() == session && b->count.load() > 0)) continue;
+        buffer = b.get();
+        buffer->owned.store(true);
+        break;
+    }
+    if (!buffer) {
+        tracer.buffers.emplace_back(new TraceBuffer());
+        buffer = tracer.buffers.back().get();
+    }
+    buffer->events.resize(TRACE_BUFFER_EVENTS);
+    buffer->threadName = traceThread.name;
+    return buffer;
+}
+
+void traceRecord(const char* name, uint64_t begin, uint64_t end) {
+    TraceBuffer* b = traceThread.buffer;
+    if (!b) b = traceThread.buffer = acquireTraceBuffer();
+
+    uint32_t session = tracer.session.load(std::memory_order_relaxed);
+    if (b->session.load(std::memory_order_relaxed) != session) {
+        b->count.store(0, std::memory_order_relaxed);
+        b->dropped.store(0, std::memory_order_relaxed);
+        b->session.store(session, std::memory_order_release);
+    }
+
+    uint32_t n = b->count.load(std::memory_order_relaxed);
+    if (n == TRACE_BUFFER_EVENTS) {
+        b->dropped.store(b->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    b->events[n] = { name, begin, end };
+    b->count.store(n + 1, std::memory_order_release);
+}
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name(name) {
+        if (tracer.recording.load(std::memory_order_relaxed)) begin = traceNow();
+    }
+    ~TraceScope() {
+        if (begin) traceRecord(name, begin, traceNow());
+    }
+
+private:
+    const char* name;
+    uint64_t begin = 0;
+};
+
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __COUNTER__)(name)
+
+void traceThreadName(const char* name) {
+    traceThread.name = name;
+    if (traceThread.buffer) traceThread.buffer->threadName = name;
+}
+
+void startTrace() {
+    if (tracer.recording.load()) return;
+    tracer.session.fetch_add(1);
+    tracer.startTicks = traceNow();
+    tracer.startTime = std::chrono::steady_clock::now();
+    tracer.recording.store(true);
+    printf("Trace: recording\n");
+}
+
+// Stops recording and writes the session. Scopes still open on other threads
+// land after the counts are read and are left out.
+void stopTrace() {
+    if (!tracer.recording.load()) return;
+    tracer.recording.store(false);
+    uint64_t endTicks = traceNow();
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tracer.startTime).count();
+    double ticksPerUs = us > 0.0 && endTicks > tracer.startTicks ? (endTicks - tracer.startTicks) / us : 1.0;
+
+    FILE* f = fopen(tracePath.c_str(), "w");
+    if (!f) {
+        printf("Trace: cannot write %s\n", tracePath.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    uint32_t session = tracer.session.load();
+    long long written = 0, dropped = 0;
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    for (size_t t = 0; t < tracer.buffers.size(); ++t) {
+        const TraceBuffer& b = *tracer.buffers[t];
+        if (b.session.load(std::memory_order_acquire) != session) continue;
+        uint32_t count = b.count.load(std::memory_order_acquire);
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", (int)t + 1, b.threadName);
+        first = false;
+        for (uint32_t i = 0; i < count; ++i) {
+            const TraceEvent& e = b.events[i];
+            if (e.begin < tracer.startTicks) continue; // Opened before the session started
+            fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                e.name, (int)t + 1, (e.begin - tracer.startTicks) / ticksPerUs, (e.end - e.begin) / ticksPerUs);
+            written++;
+        }
+        dropped += b.dropped.load(std::memory_order_relaxed);
+    }
+    fputs("\n]}\n", f);
+    fclose(f);
+    printf("Trace: wrote %s (%.1f ms, %lld events, %lld dropped, %.0f TSC ticks/us)\n",
+        tracePath.c_str(), us / 1000.0, written, dropped, ticksPerUs);
+}
+
+void toggleTrace() {
+    if (tracer.recording.load()) stopTrace();
+    else startTrace();
+}
+#else
+#define TRACE_SCOPE(name)
+
+void traceThreadName(const char*) {}
+void startTrace() { printf("Trace: compiled out (TRACING=0)\n"); }
+void stopTrace() {}
+void toggleTrace() { startTrace(); }
+#endif
+
+// ------------------
+// Performance counters
+// ------------------
+// Linux only, opt-in with --counters <csv>. One perf_event group on the game thread
+// (cycles, instructions, L1D and LLC read misses, branch misses), read with a
+// single read() on entry and exit of each tick phase. The phases don't nest, so
+// per-phase sums add up to the tick. Every COUNTER_WINDOW_TICKS the window's sums
+// go to the CSV, one row per phase; totals are printed on exit. Each read is a
+// syscall, so enabled counters slow the tick by a few microseconds; disabled, a
+// phase costs one branch. Counters the CPU (or VM) lacks are left out of the group.
+enum TickPhase {
+    PHASE_INPUT, PHASE_STAGE, PHASE_ENEMIES, PHASE_BULLETS, PHASE_BEAMS,
+    PHASE_BEAM_COLLISIONS, PHASE_COLLISIONS, PHASE_TRAILS, PHASE_PARTICLES, PHASE_COUNT
+};
+const char* tickPhaseNames[PHASE_COUNT] = {
+    "input", "updateStage", "enemies", "updateBullets", "updateBeams",
+    "handleBeamCollisions", "handleCollisions", "recordTrails", "particles"
+};
+
+enum HardwareCounter { HW_CYCLES, HW_INSTRUCTIONS, HW_L1D_MISSES, HW_LLC_MISSES, HW_BRANCH_MISSES, HW_COUNTER_COUNT };
+const char* hardwareCounterNames[HW_COUNTER_COUNT] = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+const int COUNTER_WINDOW_TICKS = 60;
+
+struct PhaseCounters {
+    long long calls = 0;
+    uint64_t values[HW_COUNTER_COUNT] = {};
+};
+
+struct PerfCounters {
+    bool active = false;
+    int fds[HW_COUNTER_COUNT];
+    int leader = -1;             // First opened counter; reads the whole group
+    int slot[HW_COUNTER_COUNT];  // Position in the group read, -1 if not opened
+    int opened = 0;
+    int ticks = 0;
+    FILE* csv = nullptr;
+    PhaseCounters window[PHASE_COUNT], total[PHASE_COUNT];
+} perfCounters;
+
+#ifdef __linux__
+bool openPerfCounters(const std::string& csvPath) {
+    const uint64_t cacheReadMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const uint32_t types[HW_COUNTER_COUNT] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+    const uint64_t configs[HW_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | cacheReadMiss, PERF_COUNT_HW_CACHE_LL | cacheReadMiss,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    PerfCounters& pc = perfCounters;
+    int& leader = pc.leader;
+    for (int c = 0; c < HW_COUNTER_COUNT; ++c) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[c];
+        attr.config = configs[c];
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.disabled = leader < 0;  // The group starts with its leader
+        attr.exclude_kernel = 1;     // Allowed at perf_event_paranoid 2
+        attr.exclude_hv = 1;
+        pc.fds[c] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0); // This thread, any CPU
+        pc.slot[c] = pc.fds[c] >= 0 ? pc.opened++ : -1;
+        if (pc.fds[c] >= 0 && leader < 0) leader = pc.fds[c];
+    }
+    if (leader < 0) {
+        printf("Counters: perf_event_open failed (%s)\n", strerror(errno));
+        return false;
+    }
+
+    pc.csv = fopen(csvPath.c_str(), "w");
+    if (!pc.csv) {
+        printf("Counters: cannot write %s\n", csvPath.c_str());
+        for (int fd : pc.fds) if (fd >= 0) close(fd);
+        return false;
+    }
+    fprintf(pc.csv, "tick,phase,calls");
+    for (const char* name : hardwareCounterNames) fprintf(pc.csv, ",%s", name);
+    fprintf(pc.csv, ",ipc\n");
+
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    pc.active = true;
+
+    printf("Counters:");
+    for (int c = 0; c < HW_COUNTER_COUNT; ++c) printf(" %s%s", hardwareCounterNames[c], pc.slot[c] < 0 ? " (unavailable)" : "");
+    printf(" -> %s\n", csvPath.c_str());
+    return true;
+}
+
+// Raw group read; scaling for multiplexing is done on the difference of two reads
+struct PerfReading {
+    uint64_t enabled, running;
+    uint64_t values[HW_COUNTER_COUNT];
+};
+
+// False on a failed read
+bool readPerfCounters(PerfReading& reading) {
+    PerfCounters& pc = perfCounters;
+    uint64_t buffer[3 + HW_COUNTER_COUNT]; // nr, time enabled, time running, values
+    if (read(pc.leader, buffer, sizeof(buffer)) < (ssize_t)((3 + pc.opened) * sizeof(uint64_t))) return false;
+
+    reading.enabled = buffer[1];
+    reading.running = buffer[2];
+    for (int c = 0; c < HW_COUNTER_COUNT; ++c) reading.values[c] = pc.slot[c] >= 0 ? buffer[3 + pc.slot[c]] : 0;
+    return true;
+}
+
+// Counts between two reads, scaled up by how long the group was multiplexed off the PMU
+// in between. Scaling the raw totals first would let a changing ratio make end < begin
+void perfCounterDelta(const PerfReading& begin, const PerfReading& end, uint64_t* delta) {
+    uint64_t enabled = end.enabled - begin.enabled;
+    uint64_t running = end.running - begin.running;
+    double scale = running > 0 && running < enabled ? (double)enabled / running : 1.0;
+    for (int c = 0; c < HW_COUNTER_COUNT; ++c) delta[c] = (uint64_t)((end.values[c] - begin.values[c]) * scale);
+}
+
+class CounterScope {
+public:
+    explicit CounterScope(TickPhase phase) : phase(phase) {
+        if (perfCounters.active) ok = readPerfCounters(begin);
+    }
+    ~CounterScope() {
+        if (!ok) return;
+        PerfReading end;
+        if (!readPerfCounters(end)) return;
+        uint64_t delta[HW_COUNTER_COUNT];
+        perfCounterDelta(begin, end, delta);
+        PhaseCounters& w = perfCounters.window[phase];
+        w.calls++;
+        for (int c = 0; c < HW_COUNTER_COUNT; ++c) w.values[c] += delta[c];
+    }
+
+private:
+    TickPhase phase;
+    bool ok = false;
+    PerfReading begin;
+};
+
+#define COUNTER_SCOPE(phase) CounterScope TRACE_CONCAT(counterScope, __COUNTER__)(phase)
+#else
+bool openPerfCounters(const std::string&) {
+    printf("Counters: perf_event_open is Linux only\n");
+    return false;
+}
+
+#define COUNTER_SCOPE(phase)
+#endif
+
+// A tick phase on the timeline and, with --counters, in the hardware counters
+#define TICK_PHASE(phase) TRACE_SCOPE(tickPhaseNames[phase]); COUNTER_SCOPE(phase)
+
+// End of a tick: every COUNTER_WINDOW_TICKS the window goes to the CSV and the totals
+void finishCounterTick() {
+    PerfCounters& pc = perfCounters;
+    if (!pc.active || ++pc.ticks % COUNTER_WINDOW_TICKS != 0) return;
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        PhaseCounters& w = pc.window[p];
+        if (w.calls == 0) continue;
+        fprintf(pc.csv, "%d,%s,%lld", pc.ticks, tickPhaseNames[p], w.calls);
+        for (int c = 0; c < HW_COUNTER_COUNT; ++c) {
+            if (pc.slot[c] >= 0) fprintf(pc.csv, ",%llu", (unsigned long long)w.values[c]);
+            else fprintf(pc.csv, ",");
+        }
+        fprintf(pc.csv, ",%.3f\n", w.values[HW_CYCLES] > 0 ? (double)w.values[HW_INSTRUCTIONS] / w.values[HW_CYCLES] : 0.0);
+
+        PhaseCounters& t = pc.total[p];
+        t.calls += w.calls;
+        for (int c = 0; c < HW_COUNTER_COUNT; ++c) t.values[c] += w.values[c];
+        w = PhaseCounters();
+    }
+}
+
+// Misses per 1000 instructions, "-" for a counter that didn't open
+void printPerMille(const PhaseCounters& p, HardwareCounter c) {
+    if (perfCounters.slot[c] < 0 || p.values[HW_INSTRUCTIONS] == 0) printf(" %8s", "-");
+    else printf(" %8.2f", 1000.0 * p.values[c] / p.values[HW_INSTRUCTIONS]);
+}
+
+// Per-phase totals, then closes the counters
+void closePerfCounters() {
+    PerfCounters& pc = perfCounters;
+    if (!pc.active) return;
+    pc.active = false;
+    fclose(pc.csv);
+#ifdef __linux__
+    for (int fd : pc.fds) if (fd >= 0) close(fd);
+#endif
+
+    printf("Counters over %d ticks (misses per 1000 instructions):\n", pc.ticks - pc.ticks % COUNTER_WINDOW_TICKS);
+    printf("  %-22s %12s %8s %8s %8s %8s\n", "phase", "cycles/call", "ipc", "l1d", "llc", "branch");
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        const PhaseCounters& t = pc.total[p];
+        if (t.calls == 0) continue;
+        printf("  %-22s %12.0f %8.2f", tickPhaseNames[p], (double)t.values[HW_CYCLES] / t.calls,
+            t.values[HW_CYCLES] > 0 ? (double)t.values[HW_INSTRUCTIONS] / t.values[HW_CYCLES] : 0.0);
+        printPerMille(t, HW_L1D_MISSES);
+        printPerMille(t, HW_LLC_MISSES);
+        printPerMille(t, HW_BRANCH_MISSES);
+        printf("\n");
+    }
+}
+
+// ------------------
+// Vertex arrays
+// ------------------
+GLfloat playerVertices[30];
+GLfloat squareVertices[8];
+GLfloat circleVertices[2 * (1 + 36 + 1) /*center + 36 segments + back to first point*/];
+GLfloat bossVertices[2*(1+36+10)];
+
+// Initialize each centered at origin
+void initializeVA() {
+
+    // Main body
+    playerVertices[0] = -0.05f; playerVertices[1] = -0.10f;
+    playerVertices[2] =  0.05f; playerVertices[3] = -0.10f;
+    playerVertices[4] =  0.05f; playerVertices[5] =  0.10f;
+    playerVertices[6] = -0.05f; playerVertices[7] =  0.10f;
+
+    // Top triangle
+    playerVertices[8]  = -0.05f; playerVertices[9]  = 0.10f;
+    playerVertices[10] =  0.05f; playerVertices[11] = 0.10f;
+    playerVertices[12] =  0.0f;  playerVertices[13] = 0.20f;
+
+    // Left engine
+    playerVertices[14] = -0.10f; playerVertices[15] = -0.05f;
+    playerVertices[16] = -0.05f; playerVertices[17] = -0.05f;
+    playerVertices[18] = -0.05f; playerVertices[19] =  0.05f;
+    playerVertices[20] = -0.10f; playerVertices[21] =  0.05f;
+
+    // Right engine
+    playerVertices[22] = 0.05f; playerVertices[23] = -0.05f;
+    playerVertices[24] = 0.10f; playerVertices[25] = -0.05f;
+    playerVertices[26] = 0.10f; playerVertices[27] =  0.05f;
+    playerVertices[28] = 0.05f; playerVertices[29] =  0.05f;
+
+    // ------------------
+
+    // Square
+    squareVertices[0] = -0.5f; squareVertices[1] = -0.5f;
+    squareVertices[2] = 0.5f;  squareVertices[3] = -0.5f;
+    squareVertices[4] = 0.5f;  squareVertices[5] = 0.5f;
+    squareVertices[6] = -0.5f; squareVertices[7] = 0.5f;
+
+    // Circle
+    circleVertices[0] = 0.0f; circleVertices[1] = 0.0f;
+    for (int i = 0; i < 36; ++i) {
+        float angle = 2.0f * PI * i / 36;
+        circleVertices[2 * (i + 1)] = cos(angle);
+        circleVertices[2 * (i + 1) + 1] = sin(angle);
+    }
+    circleVertices[2 * (36 + 1)] = circleVertices[2];
+    circleVertices[2 * (36 + 1) + 1] = circleVertices[3];
+
+    // --- Boss: circle + star ---
+    bossVertices[0] = 0.0f; bossVertices[1] = 0.0f;
+    for(int i=0;i<36;i++){
+        float angle = 2*PI*i/36;
+        bossVertices[2*(i+1)] = cos(angle)*0.5f;
+        bossVertices[2*(i+1)+1] = sin(angle)*0.5f;
+    }
+    float starOuter=1.0f, starInner=0.35f;
+    for(int i=0;i<5;i++){
+        float angleOuter = 2*PI*i/5 - PI/2;
+        float angleInner = angleOuter + PI/5;
+        bossVertices[2*(36+1 + i*2)]   = cos(angleOuter)*starOuter;
+        bossVertices[2*(36+1 + i*2)+1] = sin(angleOuter)*starOuter;
+        bossVertices[2*(36+1 + i*2+1)]   = cos(angleInner)*starInner;
+        bossVertices[2*(36+1 + i*2+1)+1] = sin(angleInner)*starInner;
+    }
+}
+
+// ------------------
+// Basic drawing functions
+// ------------------
+void drawPlayer_(float size) {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2,GL_FLOAT,0,playerVertices);
+    glPushMatrix();
+    glScalef(size,size,1.0f);
+    glDrawArrays(GL_QUADS,0,4);
+    glDrawArrays(GL_TRIANGLES,4,3);
+    glDrawArrays(GL_QUADS,7,4);
+    glDrawArrays(GL_QUADS,11,4);
+    glPopMatrix();
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void drawSquare(float size) {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, squareVertices);
+    glPushMatrix();
+    glScalef(size, size, 1.0f);
+    glDrawArrays(GL_QUADS, 0, 4);
+    glPopMatrix();
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void drawCircle(float radius) {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, circleVertices);
+    glPushMatrix();
+    glScalef(radius, radius, 1.0f);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 36 + 2);
+    glPopMatrix();
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void drawBoss(float radius){
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2,GL_FLOAT,0,bossVertices);
+    glPushMatrix();
+    glScalef(radius,radius,1.0f);
+    glDrawArrays(GL_TRIANGLE_FAN,0,37);
+    glDrawArrays(GL_TRIANGLE_FAN,37,10);
+    glPopMatrix();
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// ------------------
+// Shaders
+// ------------------
+// GLSL 1.20 programs read the fixed-function projection, so shader draws share it
+// with the rest of the scene. World programs add the camera (createWorldProgram)
+GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        printf("Shader: compile failed: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// attributes: nullptr-terminated names, bound to locations 0, 1, ... in order. Returns 0 on failure
+GLuint createProgram(const char* vertexSource, const char* fragmentSource, const char* const* attributes) {
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vs || !fs) {
+        if (vs) glDeleteShader(vs);
+        if (fs) glDeleteShader(fs);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    for (GLuint i = 0; attributes && attributes[i]; ++i) glBindAttribLocation(program, i, attributes[i]);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        printf("Shader: link failed: %s\n", log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// ------------------
+// Camera
+// ------------------
+// Pan, zoom and shake make up one per-frame view transform, world -> view =
+// p * scale + offset. Shader draws read it from a uniform block that is written once
+// per frame and shared by every world program, so shaking never touches vertex data
+// or splits a batch; fixed-function draws get the same transform as the modelview
+// matrix, loaded once per frame. Shake follows trauma: hits add it, it decays every
+// tick, and the offset grows with its square, so a graze of trauma barely moves the
+// screen and a death kicks. Trauma is simulation state (snapshots, rollback and
+// replays shake alike); only the random direction is drawn per frame.
+const float SHAKE_MAX_OFFSET = 0.04f;
+const float SHAKE_MAX_ZOOM = 0.03f;      // Punch-in at full trauma
+const float TRAUMA_DECAY = 1.0f / 30.0f; // Per tick: full trauma settles in half a second
+const float TRAUMA_HIT = 0.5f;           // Boss hit, player death
+const GLuint VIEW_BLOCK_BINDING = 0;
+
+float shakeTrauma = 0.0f;
+
+void addTrauma(float amount) {
+    shakeTrauma = std::min(shakeTrauma + amount, 1.0f);
+}
+
+// Every tick, and every frame once the game is over so the last shake settles
+void decayTrauma() {
+    shakeTrauma = std::max(shakeTrauma - TRAUMA_DECAY, 0.0f);
+}
+
+struct Camera {
+    float x = 0.0f, y = 0.0f; // Centre of the view
+    float zoom = 1.0f;
+    float view[4] = { 1.0f, 1.0f, 0.0f, 0.0f }; // This frame's scale xy, offset xy
+    bool uniformBlock = false;
+    GLuint buffer = 0;
+    std::vector<std::pair<GLuint, GLint>> programs; // Without uniform blocks: each program's own uniform
+} camera;
+
+// Prepended to world vertex shaders, which call worldToClip instead of reading the
+// modelview matrix. Without uniform buffer objects the view is a plain uniform,
+// set on each program as it is used
+const char* viewBlockSource = R"(#version 120
+#extension GL_ARB_uniform_buffer_object : require
+layout(std140) uniform View { vec4 viewTransform; };
+)";
+
+const char* viewUniformSource = R"(#version 120
+uniform vec4 viewTransform;
+)";
+
+const char* viewFunctionSource = R"(
+vec4 worldToClip(vec2 p) {
+    return gl_ProjectionMatrix * vec4(p * viewTransform.xy + viewTransform.zw, 0.0, 1.0);
+}
+)";
+
+// Before the renderers that create world programs
+void initCamera() {
+    camera.uniformBlock = GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object;
+    if (!camera.uniformBlock) return;
+    glGenBuffers(1, &camera.buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, camera.buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(camera.view), camera.view, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, VIEW_BLOCK_BINDING, camera.buffer);
+}
+
+// vertexSource has no #version line; the view declarations supply it
+GLuint createWorldProgram(const char* vertexSource, const char* fragmentSource, const char* const* attributes) {
+    std::string source = std::string(camera.uniformBlock ? viewBlockSource : viewUniformSource) + viewFunctionSource + vertexSource;
+    GLuint program = createProgram(source.c_str(), fragmentSource, attributes);
+    if (!program) return 0;
+    if (camera.uniformBlock) glUniformBlockBinding(program, glGetUniformBlockIndex(program, "View"), VIEW_BLOCK_BINDING);
+    else camera.programs.push_back({ program, glGetUniformLocation(program, "viewTransform") });
+    return program;
+}
+
+void useWorldProgram(GLuint program) {
+    glUseProgram(program);
+    if (camera.uniformBlock) return;
+    for (const auto& p : camera.programs) {
+        if (p.first == program) glUniform4fv(p.second, 1, camera.view);
+    }
+}
+
+// Once per frame, before the world is drawn
+void updateCamera() {
+    float shake = shakeTrauma * shakeTrauma;
+    float scale = camera.zoom * (1.0f + SHAKE_MAX_ZOOM * shake);
+    float shakeX = 0.0f, shakeY = 0.0f;
+    if (shake > 0.0f) {
+        shakeX = shakeRng.linearRand(-1.0f, 1.0f) * SHAKE_MAX_OFFSET * shake;
+        shakeY = shakeRng.linearRand(-1.0f, 1.0f) * SHAKE_MAX_OFFSET * shake;
+    }
+    camera.view[0] = camera.view[1] = scale;
+    camera.view[2] = shakeX - camera.x * scale;
+    camera.view[3] = shakeY - camera.y * scale;
+
+    if (camera.uniformBlock) {
+        glBindBuffer(GL_UNIFORM_BUFFER, camera.buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera.view), camera.view);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    const GLfloat modelview[16] = {
+        scale, 0.0f, 0.0f, 0.0f,
+        0.0f, scale, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        camera.view[2], camera.view[3], 0.0f, 1.0f,
+    };
+    glLoadMatrixf(modelview);
+}
+
+// ------------------
+// Objects drawing functions
+// ------------------
+void drawPlayer() {
+    TRACE_SCOPE("drawPlayer");
+    if (!isPlayerAlive) return;
+
+    glPushMatrix();
+    glTranslatef(playerX, playerY, 0.0f);
+    glColor3f(0.0f, 1.0f, 0.0f);
+    drawPlayer_(playerSize);
+    glPopMatrix();
+}
+
+void drawEnemy(const Enemy& enemy) {
+    if (!enemy.isAlive) return;
+
+    glPushMatrix();
+    glTranslatef(enemy.x, enemy.y, 0.0f);
+    glColor3f(0.6f, 0.2f, 0.8f);
+    drawBoss(enemy.size);
+    glPopMatrix();    
+    
+    // HP bar
+    float barW = 0.2f;
+    float barH = 0.02f;
+    float hpRatio = std::min(std::max((float)enemy.health / std::max(enemy.maxHealth, 1), 0.0f), 1.0f);
+
+    // Background
+    glColor3f(0.3f, 0.3f, 0.3f);
+    glBegin(GL_QUADS);
+    glVertex2f(enemy.x - barW / 2, enemy.y + enemy.size + 0.03f);
+    glVertex2f(enemy.x + barW / 2, enemy.y + enemy.size + 0.03f);
+    glVertex2f(enemy.x + barW / 2, enemy.y + enemy.size + 0.03f + barH);
+    glVertex2f(enemy.x - barW / 2, enemy.y + enemy.size + 0.03f + barH);
+    glEnd();
+    
+    // Bar
+    glColor3f(1.0f - hpRatio, hpRatio, 0.0f);
+    glBegin(GL_QUADS);
+    glVertex2f(enemy.x - barW / 2, enemy.y + enemy.size + 0.03f);
+    glVertex2f(enemy.x - barW / 2 + barW * hpRatio, enemy.y + enemy.size + 0.03f);
+    glVertex2f(enemy.x - barW / 2 + barW * hpRatio, enemy.y + enemy.size + 0.03f + barH);
+    glVertex2f(enemy.x - barW / 2, enemy.y + enemy.size + 0.03f + barH);
+    glEnd();
+}
+
+void drawEnemies() {
+    TRACE_SCOPE("drawEnemies");
+    for (auto& enemy : enemies) drawEnemy(enemy);
+}
+
+void drawBullets() {
+    TRACE_SCOPE("drawBullets");
+    // Player bullet : two yellow rectangles
+    playerBullets.ensurePositions(simTick);
+    glColor3f(1.0f, 1.0f, 0.0f);
+    for (size_t i = 0; i < playerBullets.size(); ++i) {
+        glPushMatrix();
+        glTranslatef(playerBullets.x[i] - 0.75f * tuning.bulletSize, playerBullets.y[i], 0.0f);
+        drawSquare(tuning.bulletSize);
+        glPopMatrix();
+
+        glPushMatrix();
+        glTranslatef(playerBullets.x[i] + 0.75f * tuning.bulletSize, playerBullets.y[i], 0.0f);
+        drawSquare(tuning.bulletSize);
+        glPopMatrix();
+    }
+
+    // Enemy bullet : red circle
+    enemyBullets.ensurePositions(simTick);
+    glColor3f(1.0f, 0.0f, 0.0f);
+    for (size_t i = 0; i < enemyBullets.size(); ++i) {
+        glPushMatrix();
+        glTranslatef(enemyBullets.x[i], enemyBullets.y[i], 0.0f);
+        drawCircle(tuning.bulletSize);
+        glPopMatrix();
+    }
+}
+// ------------------
+
+// Fuction for collision detection
+bool rectCollision(float x1, float y1, float s1, float x2, float y2, float s2) {
+    return std::abs(x1 - x2) < (s1 + s2) / 2 && std::abs(y1 - y2) < (s1 + s2) / 2;
+}
+
+// ------------------
+// Batched collision kernels
+// ------------------
+// One target box against many bullets in SoA form. Produces a bitmask (bit i set
+// when bullet i overlaps) with the exact same float operations as rectCollision,
+// 8 bullets per compare with AVX2, 4 with SSE2, scalar otherwise.
+inline int countTrailingZeros(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return (int)index;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+inline int highestBit(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, v);
+    return (int)index;
+#else
+    return 31 - __builtin_clz(v);
+#endif
+}
+
+// Box centered at (x2, y2) with half extents (hx, hy): a bullet hits when
+// |x - x2| < hx and |y - y2| < hy. hits must hold (n + 31) / 32 words; returns the number of hits
+size_t boxCollisionMask(const float* xs, const float* ys, size_t n, float x2, float y2, float hx, float hy, uint32_t* hits) {
+    size_t count = 0;
+    size_t i = 0;
+
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 tx = _mm256_set1_ps(x2), ty = _mm256_set1_ps(y2);
+    const __m256 hwx = _mm256_set1_ps(hx), hwy = _mm256_set1_ps(hy);
+    for (; simdKernels && i + 32 <= n; i += 32) {
+        uint32_t word = 0;
+        for (int k = 0; k < 32; k += 8) {
+            __m256 dx = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(xs + i + k), tx));
+            __m256 dy = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(ys + i + k), ty));
+            __m256 hit = _mm256_and_ps(_mm256_cmp_ps(dx, hwx, _CMP_LT_OQ), _mm256_cmp_ps(dy, hwy, _CMP_LT_OQ));
+            word |= (uint32_t)_mm256_movemask_ps(hit) << k;
+        }
+        hits[i / 32] = word;
+        if (word) count += std::bitset<32>(word).count();
+    }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 tx = _mm_set1_ps(x2), ty = _mm_set1_ps(y2);
+    const __m128 hwx = _mm_set1_ps(hx), hwy = _mm_set1_ps(hy);
+    for (; simdKernels && i + 32 <= n; i += 32) {
+        uint32_t word = 0;
+        for (int k = 0; k < 32; k += 4) {
+            __m128 dx = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(xs + i + k), tx));
+            __m128 dy = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(ys + i + k), ty));
+            __m128 hit = _mm_and_ps(_mm_cmplt_ps(dx, hwx), _mm_cmplt_ps(dy, hwy));
+            word |= (uint32_t)_mm_movemask_ps(hit) << k;
+        }
+        hits[i / 32] = word;
+        if (word) count += std::bitset<32>(word).count();
+    }
+#endif
+
+    // Scalar fallback and tail
+    for (; i < n; i += 32) {
+        uint32_t word = 0;
+        size_t end = std::min(n, i + 32);
+        for (size_t j = i; j < end; ++j) {
+            bool hit = std::abs(xs[j] - x2) < hx && std::abs(ys[j] - y2) < hy;
+            word |= (uint32_t)hit << (j - i);
+        }
+        hits[i / 32] = word;
+        if (word) count += std::bitset<32>(word).count();
+    }
+    return count;
+}
+
+// Same test as rectCollision for every bullet
+size_t rectCollisionMask(const float* xs, const float* ys, size_t n, float s1, float x2, float y2, float s2, uint32_t* hits) {
+    const float half = (s1 + s2) / 2;
+    return boxCollisionMask(xs, ys, n, x2, y2, half, half, hits);
+}
+
+// Squared distance from p to the segment starting at the origin with direction d,
+// p relative to the segment start. invLenSq is 1 / |d|^2, or 0 for a point
+inline float segmentDistSq(float px, float py, float dx, float dy, float invLenSq) {
+    float t = std::min(std::max((px * dx + py * dy) * invLenSq, 0.0f), 1.0f);
+    float ex = px - t * dx, ey = py - t * dy;
+    return ex * ex + ey * ey;
+}
+
+// Capsule from (ax, ay) to (bx, by) with radius r: a bullet hits when its squared
+// distance to the segment is below r^2. The projection is clamped rather than
+// branched on, so a lane is a few mul/add/min/max and never a square root.
+size_t capsuleCollisionMask(const float* xs, const float* ys, size_t n, float ax, float ay, float bx, float by, float r, uint32_t* hits) {
+    const float dx = bx - ax, dy = by - ay;
+    const float lenSq = dx * dx + dy * dy;
+    const float invLenSq = lenSq > 0.0f ? 1.0f / lenSq : 0.0f;
+    const float rSq = r * r;
+    size_t count = 0;
+    size_t i = 0;
+
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    const __m256 vax = _mm256_set1_ps(ax), vay = _mm256_set1_ps(ay);
+    const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy);
+    const __m256 vinv = _mm256_set1_ps(invLenSq), vrSq = _mm256_set1_ps(rSq);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    for (; simdKernels && i + 32 <= n; i += 32) {
+        uint32_t word = 0;
+        for (int k = 0; k < 32; k += 8) {
+            __m256 px = _mm256_sub_ps(_mm256_loadu_ps(xs + i + k), vax);
+            __m256 py = _mm256_sub_ps(_mm256_loadu_ps(ys + i + k), vay);
+            __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(px, vdx), _mm256_mul_ps(py, vdy)), vinv);
+            t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+            __m256 ex = _mm256_sub_ps(px, _mm256_mul_ps(t, vdx));
+            __m256 ey = _mm256_sub_ps(py, _mm256_mul_ps(t, vdy));
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+            word |= (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(d, vrSq, _CMP_LT_OQ)) << k;
+        }
+        hits[i / 32] = word;
+        if (word) count += std::bitset<32>(word).count();
+    }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 vax = _mm_set1_ps(ax), vay = _mm_set1_ps(ay);
+    const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy);
+    const __m128 vinv = _mm_set1_ps(invLenSq), vrSq = _mm_set1_ps(rSq);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    for (; simdKernels && i + 32 <= n; i += 32) {
+        uint32_t word = 0;
+        for (int k = 0; k < 32; k += 4) {
+            __m128 px = _mm_sub_ps(_mm_loadu_ps(xs + i + k), vax);
+            __m128 py = _mm_sub_ps(_mm_loadu_ps(ys + i + k), vay);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(px, vdx), _mm_mul_ps(py, vdy)), vinv);
+            t = _mm_min_ps(_mm_max_ps(t, zero), one);
+            __m128 ex = _mm_sub_ps(px, _mm_mul_ps(t, vdx));
+            __m128 ey = _mm_sub_ps(py, _mm_mul_ps(t, vdy));
+            __m128 d = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+            word |= (uint32_t)_mm_movemask_ps(_mm_cmplt_ps(d, vrSq)) << k;
+        }
+        hits[i / 32] = word;
+        if (word) count += std::bitset<32>(word).count();
+    }
+#endif
+
+    // Scalar fallback and tail
+    for (; i < n; i += 32) {
+        uint32_t word = 0;
+        size_t end = std::min(n, i + 32);
+        for (size_t j = i; j < end; ++j) {
+            bool hit = segmentDistSq(xs[j] - ax, ys[j] - ay, dx, dy, invLenSq) < rSq;
+            word |= (uint32_t)hit << (j - i);
+        }
+        hits[i / 32] = word;
+        if (word) count += std::bitset<32>(word).count();
+    }
+    return count;
+}
+
+// Scratch mask shared by the collision passes
+std::vector<uint32_t> hitMask;
+
+size_t bulletHitMask(const BulletPool& pool, float tx, float ty, float tsize) {
+    hitMask.resize((pool.size() + 31) / 32);
+    return rectCollisionMask(pool.x.data(), pool.y.data(), pool.size(), tuning.bulletSize, tx, ty, tsize, hitMask.data());
+}
+
+// ------------------
+// Player hitbox
+// ------------------
+// Enemy bullets are circles tested against the convex pieces of the player mesh:
+// an AABB broadphase over the whole ship, then a separating axis test per piece.
+// The world-space pieces are rebuilt once per tick by updatePlayerHitbox.
+const int HITBOX_MAX_VERTS = 4;
+
+struct HitboxPolygon {
+    int first, count;             // Range in playerVertices
+    float x[HITBOX_MAX_VERTS], y[HITBOX_MAX_VERTS];   // World-space vertices
+    float nx[HITBOX_MAX_VERTS], ny[HITBOX_MAX_VERTS]; // Outward unit edge normals
+    float offset[HITBOX_MAX_VERTS];                   // n . v of each edge
+};
+
+struct PlayerHitbox {
+    HitboxPolygon pieces[4]; // Body, nose, left engine, right engine
+    float centerX, centerY, halfW, halfH; // Bounds of the whole ship
+};
+
+PlayerHitbox playerHitbox;
+
+// Piece ranges and normals don't change (the ship never rotates), so they are set once
+void initPlayerHitbox() {
+    const int ranges[4][2] = { { 0, 4 }, { 4, 3 }, { 7, 4 }, { 11, 4 } }; // first, count
+    for (int p = 0; p < 4; ++p) {
+        HitboxPolygon& piece = playerHitbox.pieces[p];
+        piece.first = ranges[p][0];
+        piece.count = ranges[p][1];
+        const GLfloat* v = playerVertices + 2 * piece.first;
+        float area = 0.0f;
+        for (int i = 0; i < piece.count; ++i) {
+            int j = (i + 1) % piece.count;
+            area += v[2 * i] * v[2 * j + 1] - v[2 * j] * v[2 * i + 1];
+        }
+        float winding = area >= 0.0f ? 1.0f : -1.0f; // Outward is right of each edge for CCW
+        for (int i = 0; i < piece.count; ++i) {
+            int j = (i + 1) % piece.count;
+            float ex = v[2 * j] - v[2 * i], ey = v[2 * j + 1] - v[2 * i + 1];
+            float len = std::sqrt(ex * ex + ey * ey);
+            piece.nx[i] = winding * ey / len;
+            piece.ny[i] = -winding * ex / len;
+        }
+    }
+}
+
+void updatePlayerHitbox() {
+    float minX = 1e9f, minY = 1e9f, maxX = -1e9f, maxY = -1e9f;
+    for (auto& piece : playerHitbox.pieces) {
+        const GLfloat* v = playerVertices + 2 * piece.first;
+        for (int i = 0; i < piece.count; ++i) {
+            piece.x[i] = playerX + v[2 * i] * playerSize;
+            piece.y[i] = playerY + v[2 * i + 1] * playerSize;
+            minX = std::min(minX, piece.x[i]); maxX = std::max(maxX, piece.x[i]);
+            minY = std::min(minY, piece.y[i]); maxY = std::max(maxY, piece.y[i]);
+        }
+        for (int i = 0; i < piece.count; ++i) piece.offset[i] = piece.nx[i] * piece.x[i] + piece.ny[i] * piece.y[i];
+    }
+    playerHitbox.centerX = (minX + maxX) / 2;
+    playerHitbox.centerY = (minY + maxY) / 2;
+    playerHitbox.halfW = (maxX - minX) / 2;
+    playerHitbox.halfH = (maxY - minY) / 2;
+}
+
+// Separating axis test: the edge normals, plus the axis from the closest vertex to the center
+bool circleHitsPolygon(const HitboxPolygon& p, float cx, float cy, float r) {
+    int closest = 0;
+    float closestDist = 1e30f;
+    for (int i = 0; i < p.count; ++i) {
+        if (p.nx[i] * cx + p.ny[i] * cy - p.offset[i] > r) return false;
+        float dx = cx - p.x[i], dy = cy - p.y[i];
+        float d = dx * dx + dy * dy;
+        if (d < closestDist) { closestDist = d; closest = i; }
+    }
+
+    float ax = cx - p.x[closest], ay = cy - p.y[closest];
+    float len = std::sqrt(closestDist);
+    if (len == 0.0f) return true;
+    ax /= len; ay /= len;
+    float c = ax * cx + ay * cy;
+    float pmin = 1e30f, pmax = -1e30f;
+    for (int i = 0; i < p.count; ++i) {
+        float proj = ax * p.x[i] + ay * p.y[i];
+        pmin = std::min(pmin, proj);
+        pmax = std::max(pmax, proj);
+    }
+    return !(pmax < c - r || c + r < pmin);
+}
+
+bool circleHitsPlayer(float cx, float cy, float r) {
+    for (const auto& piece : playerHitbox.pieces) {
+        if (circleHitsPolygon(piece, cx, cy, r)) return true;
+    }
+    return false;
+}
+
+// ------------------
+// Bullet sweep
+// ------------------
+// Enemy bullets sorted by x, shared by the hit and graze queries: both only scan
+// the slice of bullets whose x is within reach of the ship. Keys are x quantized to
+// 4096 columns of about 0.001, and every update is one counting sort in dense order:
+// a pass to count the columns, one to scatter. With patterns crossing each other
+// the order can't be carried over cheaply (at 50000 bullets, looking the previous
+// order up by handle alone cost more than the whole sort). Queries compare
+// quantized bounds and leave the exact test to the caller.
+const float SWEEP_KEY_MIN = -2.0f;
+const uint32_t SWEEP_COLUMNS = 4096;
+const float SWEEP_KEY_SCALE = (SWEEP_COLUMNS - 1) / 4.0f; // [-2, 2] onto the columns
+
+struct SweepEntry {
+    uint32_t key;
+    uint32_t dense; // Index into the pool, valid for the tick of the last update
+};
+
+inline uint32_t sweepKey(float x) {
+    float k = (x - SWEEP_KEY_MIN) * SWEEP_KEY_SCALE;
+    return k <= 0.0f ? 0u : k >= SWEEP_COLUMNS - 1 ? SWEEP_COLUMNS - 1 : (uint32_t)k;
+}
+
+struct BulletSweep {
+    std::vector<SweepEntry> entries;
+    std::vector<uint32_t> keys;
+    uint32_t starts[SWEEP_COLUMNS + 1]; // First entry of each column
+    int positionTick = -1; // Of the pool positions the entries were built from
+
+    void update(const BulletPool& pool) {
+        positionTick = pool.positionTick;
+        size_t n = pool.size();
+        keys.resize(n);
+        entries.resize(n);
+
+        uint32_t counts[SWEEP_COLUMNS] = {};
+        for (size_t d = 0; d < n; ++d) {
+            keys[d] = sweepKey(pool.x[d]);
+            counts[keys[d]]++;
+        }
+        uint32_t sum = 0;
+        for (uint32_t c = 0; c < SWEEP_COLUMNS; ++c) {
+            starts[c] = sum;
+            sum += counts[c];
+            counts[c] = starts[c];
+        }
+        starts[SWEEP_COLUMNS] = sum;
+        for (size_t d = 0; d < n; ++d) entries[counts[keys[d]]++] = { keys[d], (uint32_t)d };
+    }
+
+    // First entry that may have x >= value
+    size_t lowerBound(float value) const { return starts[sweepKey(value)]; }
+};
+
+BulletSweep enemySweep;
+int grazeCount = 0;
+
+// Lowest dense index of the enemy bullets touching the ship, or -1. Not the first in
+// sweep order, so the choice doesn't depend on how the sweep is built
+int findPlayerHit() {
+    const float r = tuning.bulletSize; // Enemy bullets are drawn with this radius
+    const PlayerHitbox& hb = playerHitbox;
+    const float reachX = hb.halfW + r, reachY = hb.halfH + r;
+
+    int hit = -1;
+    const auto& entries = enemySweep.entries;
+    const uint32_t last = sweepKey(hb.centerX + reachX);
+    for (size_t k = enemySweep.lowerBound(hb.centerX - reachX); k < entries.size() && entries[k].key <= last; ++k) {
+        uint32_t d = entries[k].dense;
+        if (hit >= 0 && d > (uint32_t)hit) continue;
+        if (std::abs(enemyBullets.y[d] - hb.centerY) >= reachY) continue;
+        if (circleHitsPlayer(enemyBullets.x[d], enemyBullets.y[d], r)) hit = (int)d;
+    }
+    return hit;
+}
+
+// Counts enemy bullets entering the graze radius for the first time
+int countGrazes() {
+    const float r = tuning.bulletSize;
+    const float reach = tuning.grazeRadius + r;
+    const float cx = playerHitbox.centerX, cy = playerHitbox.centerY;
+
+    int grazes = 0;
+    const auto& entries = enemySweep.entries;
+    const uint32_t last = sweepKey(cx + reach);
+    for (size_t k = enemySweep.lowerBound(cx - reach); k < entries.size() && entries[k].key <= last; ++k) {
+        uint32_t d = entries[k].dense;
+        float dx = enemyBullets.x[d] - cx, dy = enemyBullets.y[d] - cy;
+        if (dx * dx + dy * dy < reach * reach && !(enemyBullets.flags[d] & BULLET_GRAZED)) {
+            enemyBullets.flags[d] |= BULLET_GRAZED;
+            grazes++;
+        }
+    }
+    return grazes;
+}
+
+// ------------------
+// Snapshots
+// ------------------
+// The whole simulation state in one flat blob: a header, the scalar globals, then
+// every container as raw arrays. Saving appends into a reused vector and restoring
+// copies back into the live containers' capacity, so neither allocates once warm.
+// Derived and visual state is left out: the sweep (rebuilt from the pool), the
+// hitbox (rebuilt each tick), particles and trails. Bump SNAPSHOT_VERSION whenever
+// the layout changes; blobs of another version are rejected.
+const uint32_t SNAPSHOT_MAGIC = 0x50414e53; // "SNAP"
+const uint32_t SNAPSHOT_VERSION = 7;
+const int SNAPSHOT_RING_SIZE = 64;
+
+struct SnapshotHeader {
+    uint32_t magic, version;
+    uint64_t size; // Whole blob, header included
+};
+
+struct SnapshotGlobals {
+    int simTick;
+    float playerX, playerY;
+    int playerLives;
+    bool isPlayerAlive, isGameOver;
+    int playerFireCooldown, respawnTimer;
+    float shakeTrauma;
+    int grazeCount, garbageCharge;
+    int stageStartTick, stageCursor;
+    Handle bossHandle, playerBeam;
+};
+
+SnapshotGlobals captureGlobals() {
+    SnapshotGlobals g;
+    memset(&g, 0, sizeof(g)); // Padding too, so equal states give equal blobs
+    g.simTick = simTick;
+    g.playerX = playerX; g.playerY = playerY;
+    g.playerLives = playerLives;
+    g.isPlayerAlive = isPlayerAlive; g.isGameOver = isGameOver;
+    g.playerFireCooldown = playerFireCooldown; g.respawnTimer = respawnTimer; g.shakeTrauma = shakeTrauma;
+    g.grazeCount = grazeCount; g.garbageCharge = garbageCharge;
+    g.stageStartTick = stageStartTick; g.stageCursor = stageCursor;
+    g.bossHandle = bossHandle; g.playerBeam = playerBeam;
+    return g;
+}
+
+void saveSnapshot(std::vector<uint8_t>& blob) {
+    TRACE_SCOPE("saveSnapshot");
+    blob.clear();
+    SnapshotWriter w{ blob };
+    w.put(SnapshotHeader{ SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 0 });
+    w.put(captureGlobals());
+    w.put(patternRng);
+    enemies.save(w);
+    beams.save(w);
+    playerBullets.save(w);
+    enemyBullets.save(w);
+
+    uint64_t size = blob.size();
+    memcpy(blob.data() + offsetof(SnapshotHeader, size), &size, sizeof(size));
+}
+
+// Returns false, leaving the state untouched, for a blob of another layout version
+bool restoreSnapshot(const std::vector<uint8_t>& blob) {
+    TRACE_SCOPE("restoreSnapshot");
+    SnapshotReader r{ blob.data(), blob.data() + blob.size() };
+    SnapshotHeader header;
+    r.get(header);
+    if (!r.ok || header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION || header.size != blob.size()) return false;
+
+    SnapshotGlobals g;
+    r.get(g);
+    simTick = g.simTick;
+    playerX = g.playerX; playerY = g.playerY;
+    playerLives = g.playerLives;
+    isPlayerAlive = g.isPlayerAlive; isGameOver = g.isGameOver;
+    playerFireCooldown = g.playerFireCooldown; respawnTimer = g.respawnTimer; shakeTrauma = g.shakeTrauma;
+    grazeCount = g.grazeCount; garbageCharge = g.garbageCharge;
+    stageStartTick = g.stageStartTick; stageCursor = g.stageCursor;
+    bossHandle = g.bossHandle; playerBeam = g.playerBeam;
+    r.get(patternRng);
+    enemies.load(r);
+    beams.load(r);
+    playerBullets.load(r);
+    enemyBullets.load(r);
+    return r.ok;
+}
+
+// The last SNAPSHOT_RING_SIZE ticks, one snapshot per tick, blobs reused in place
+struct SnapshotRing {
+    std::vector<uint8_t> blobs[SNAPSHOT_RING_SIZE];
+    int ticks[SNAPSHOT_RING_SIZE];
+    int next = 0, count = 0;
+
+    void push() {
+        saveSnapshot(blobs[next]);
+        ticks[next] = simTick;
+        next = (next + 1) % SNAPSHOT_RING_SIZE;
+        count = std::min(count + 1, SNAPSHOT_RING_SIZE);
+    }
+
+    // Newest snapshot taken at or before tick, or nullptr
+    const std::vector<uint8_t>* find(int tick) const {
+        for (int k = 1; k <= count; ++k) {
+            int i = (next - k + SNAPSHOT_RING_SIZE) % SNAPSHOT_RING_SIZE;
+            if (ticks[i] <= tick) return &blobs[i];
+        }
+        return nullptr;
+    }
+
+    // Forgets snapshots newer than tick, after the state went back to it
+    void discardAfter(int tick) {
+        while (count > 0) {
+            int newest = (next - 1 + SNAPSHOT_RING_SIZE) % SNAPSHOT_RING_SIZE;
+            if (ticks[newest] <= tick) break;
+            next = newest;
+            count--;
+        }
+    }
+
+    void clear() { next = count = 0; }
+};
+
+SnapshotRing snapshots;
+std::vector<uint8_t> checkpoint; // Retry point, saved with K
+
+// Rewinds through the ring, e.g. to undo a death
+bool rewindTicks(int ticks) {
+    const std::vector<uint8_t>* blob = snapshots.find(simTick - ticks);
+    if (!blob || !restoreSnapshot(*blob)) return false;
+    snapshots.discardAfter(simTick);
+    return true;
+}
+
+// ------------------
+// State hash
+// ------------------
+// 64-bit hash of exactly what a snapshot holds, fed through the same save()
+// functions: XXH64 over the stream, 32-byte stripes in four lanes. Equal states
+// give equal hashes, padding included, which is why new enemies and beams start
+// zeroed. A hash log (--hash-log) from two builds, e.g. AVX2 and SSE2, diffs to
+// the first tick they disagree on; --verify-backends runs the SIMD and scalar
+// kernels side by side in one process and names the entity that went first.
+class StateHasher {
+public:
+    explicit StateHasher(uint64_t seed = 0) {
+        lanes[0] = seed + P1 + P2;
+        lanes[1] = seed + P2;
+        lanes[2] = seed;
+        lanes[3] = seed - P1;
+    }
+
+    template <typename T>
+    void put(const T& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "hashed values must be plain data");
+        append(&v, sizeof(T));
+    }
+
+    template <typename T>
+    void putArray(const std::vector<T>& v) {
+        put((uint32_t)v.size());
+        append(v.data(), v.size() * sizeof(T));
+    }
+
+    void append(const void* data, size_t bytes) {
+        const uint8_t* p = (const uint8_t*)data;
+        total += bytes;
+        if (buffered > 0) {
+            size_t take = std::min(bytes, (size_t)32 - buffered);
+            memcpy(buffer + buffered, p, take);
+            buffered += take;
+            p += take;
+            bytes -= take;
+            if (buffered < 32) return;
+            stripe(buffer);
+            buffered = 0;
+        }
+        for (; bytes >= 32; p += 32, bytes -= 32) stripe(p);
+        memcpy(buffer, p, bytes);
+        buffered = bytes;
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total >= 32) {
+            h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+            for (uint64_t lane : lanes) h = (h ^ round(0, lane)) * P1 + P4;
+        }
+        else h = lanes[2] + P5;
+        h += total;
+
+        size_t i = 0;
+        for (; i + 8 <= buffered; i += 8) h = rotl(h ^ round(0, read64(buffer + i)), 27) * P1 + P4;
+        if (i + 4 <= buffered) {
+            uint32_t k;
+            memcpy(&k, buffer + i, 4);
+            h = rotl(h ^ (k * P1), 23) * P2 + P3;
+            i += 4;
+        }
+        for (; i < buffered; ++i) h = rotl(h ^ (buffer[i] * P5), 11) * P1;
+
+        h ^= h >> 33; h *= P2;
+        h ^= h >> 29; h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static const uint64_t P1 = 0x9E3779B185EBCA87ull, P2 = 0xC2B2AE3D27D4EB4Full, P3 = 0x165667B19E3779F9ull;
+    static const uint64_t P4 = 0x85EBCA77C2B2AE63ull, P5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t lanes[4];
+    uint8_t buffer[32];
+    size_t buffered = 0;
+    uint64_t total = 0;
+
+    static uint64_t rotl(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+    static uint64_t round(uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; }
+    static uint64_t read64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+    void stripe(const uint8_t* p) {
+        for (int k = 0; k < 4; ++k) lanes[k] = round(lanes[k], read64(p + k * 8));
+    }
+};
+
+uint64_t hashState() {
+    StateHasher h;
+    h.put(captureGlobals());
+    h.put(patternRng);
+    enemies.save(h);
+    beams.save(h);
+    playerBullets.save(h);
+    enemyBullets.save(h);
+    return h.digest();
+}
+
+// --hash-log: "tick hash" per simulated tick, to diff against another build's log
+FILE* hashLog = nullptr;
+
+void logStateHash() {
+    if (hashLog) fprintf(hashLog, "%d %016llx\n", simTick, (unsigned long long)hashState());
+}
+
+// Divergence reports: the first field that differs between two copies of the state
+template <typename T>
+bool reportField(const char* what, const char* field, const T& a, const T& b) {
+    if (a == b) return false;
+    printf("  %s: %s %.9g vs %.9g\n", what, field, (double)a, (double)b);
+    return true;
+}
+
+bool compareGlobals(const SnapshotGlobals& a, const SnapshotGlobals& b) {
+    return reportField("globals", "simTick", a.simTick, b.simTick)
+        || reportField("globals", "playerX", a.playerX, b.playerX)
+        || reportField("globals", "playerY", a.playerY, b.playerY)
+        || reportField("globals", "playerLives", a.playerLives, b.playerLives)
+        || reportField("globals", "isPlayerAlive", a.isPlayerAlive, b.isPlayerAlive)
+        || reportField("globals", "isGameOver", a.isGameOver, b.isGameOver)
+        || reportField("globals", "playerFireCooldown", a.playerFireCooldown, b.playerFireCooldown)
+        || reportField("globals", "respawnTimer", a.respawnTimer, b.respawnTimer)
+        || reportField("globals", "shakeTrauma", a.shakeTrauma, b.shakeTrauma)
+        || reportField("globals", "grazeCount", a.grazeCount, b.grazeCount)
+        || reportField("globals", "garbageCharge", a.garbageCharge, b.garbageCharge)
+        || reportField("globals", "stageStartTick", a.stageStartTick, b.stageStartTick)
+        || reportField("globals", "stageCursor", a.stageCursor, b.stageCursor)
+        || reportField("globals", "bossHandle", a.bossHandle, b.bossHandle)
+        || reportField("globals", "playerBeam", a.playerBeam, b.playerBeam);
+}
+
+bool comparePools(const char* name, const BulletPool& a, const BulletPool& b) {
+    if (reportField(name, "bullet count", a.size(), b.size())) return true;
+    char what[64];
+    for (size_t i = 0; i < a.size(); ++i) {
+        snprintf(what, sizeof(what), "%s bullet %08x (dense %zu)", name, a.handleAt(i), i);
+        if (reportField(what, "handle", a.handleAt(i), b.handleAt(i))
+            || reportField(what, "x", a.x[i], b.x[i]) || reportField(what, "y", a.y[i], b.y[i])
+            || reportField(what, "x0", a.x0[i], b.x0[i]) || reportField(what, "y0", a.y0[i], b.y0[i])
+            || reportField(what, "vx", a.vx[i], b.vx[i]) || reportField(what, "vy", a.vy[i], b.vy[i])
+            || reportField(what, "spawnTick", a.spawnTick[i], b.spawnTick[i])
+            || reportField(what, "deathTick", a.deathTick[i], b.deathTick[i])
+            || reportField(what, "kind", a.kind[i], b.kind[i])
+            || reportField(what, "flags", a.flags[i], b.flags[i])) return true;
+        if (memcmp(&a.params[i], &b.params[i], sizeof(TrajectoryParams)) != 0) {
+            printf("  %s: trajectory params\n", what);
+            return true;
+        }
+    }
+    return reportField(name, "positionTick", a.positionTick, b.positionTick);
+}
+
+template <typename T>
+bool compareSlotMaps(const char* name, const SlotMap<T>& a, const SlotMap<T>& b) {
+    if (reportField(name, "count", a.size(), b.size())) return true;
+    char what[64];
+    for (size_t i = 0; i < a.size(); ++i) {
+        snprintf(what, sizeof(what), "%s %08x (dense %zu)", name, a.handleAt(i), i);
+        if (reportField(what, "handle", a.handleAt(i), b.handleAt(i))) return true;
+        if (memcmp(&a[i], &b[i], sizeof(T)) != 0) {
+            printf("  %s: contents\n", what);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Both copies as they stand; false if nothing differs (the hash would then agree too)
+bool reportDivergence(const SnapshotGlobals& g, const Rng& rng, const SlotMap<Enemy>& e, const SlotMap<Beam>& b,
+                      const BulletPool& player, const BulletPool& enemy) {
+    if (memcmp(&rng, &patternRng, sizeof(Rng)) != 0) {
+        printf("  pattern random stream\n");
+        return true;
+    }
+    return compareGlobals(g, captureGlobals())
+        || compareSlotMaps("enemy", e, enemies)
+        || compareSlotMaps("beam", b, beams)
+        || comparePools("player", player, playerBullets)
+        || comparePools("enemy", enemy, enemyBullets);
+}
+
+// ------------------
+// Beams
+// ------------------
+// A beam is a capsule: every point within radius of its segment. Enemy bullets
+// go through capsuleCollisionMask; enemy boxes and the player pieces are convex
+// polygons, tested exactly with segmentPolygonDistSq.
+const float BEAM_LENGTH = 3.0f; // Reaches across the window from anywhere on it
+
+void beamEnd(const Beam& beam, float& bx, float& by) {
+    bx = beam.x + std::cos(beam.angle) * beam.length;
+    by = beam.y + std::sin(beam.angle) * beam.length;
+}
+
+Handle fireBeam(float x, float y, float angle, float sweep, float radius, int warmup, int ticks, uint8_t flags, Handle owner) {
+    Beam beam = Beam(); // Zeroed padding, see "State hash"
+    beam.x = x; beam.y = y;
+    beam.angle = angle; beam.sweep = sweep;
+    beam.length = BEAM_LENGTH; beam.radius = radius;
+    beam.warmup = warmup; beam.ticksLeft = ticks;
+    beam.damageTimer = 0;
+    beam.flags = flags;
+    beam.owner = owner;
+    return beams.insert(beam);
+}
+
+inline float cross2(float ax, float ay, float bx, float by) { return ax * by - ay * bx; }
+
+bool segmentsCross(float ax, float ay, float bx, float by, float cx, float cy, float dx, float dy) {
+    float d1 = cross2(bx - ax, by - ay, cx - ax, cy - ay);
+    float d2 = cross2(bx - ax, by - ay, dx - ax, dy - ay);
+    float d3 = cross2(dx - cx, dy - cy, ax - cx, ay - cy);
+    float d4 = cross2(dx - cx, dy - cy, bx - cx, by - cy);
+    return ((d1 > 0) != (d2 > 0)) && ((d3 > 0) != (d4 > 0));
+}
+
+// Squared distance between segment AB and a convex polygon, 0 when they overlap.
+// Apart, the closest pair always involves a vertex of one of them.
+float segmentPolygonDistSq(const float* px, const float* py, int count, float ax, float ay, float bx, float by) {
+    float area = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        int j = (i + 1) % count;
+        area += cross2(px[i], py[i], px[j], py[j]);
+    }
+
+    bool aInside = true;
+    float best = 1e30f;
+    const float dx = bx - ax, dy = by - ay;
+    const float lenSq = dx * dx + dy * dy;
+    const float invLenSq = lenSq > 0.0f ? 1.0f / lenSq : 0.0f;
+    for (int i = 0; i < count; ++i) {
+        int j = (i + 1) % count;
+        float ex = px[j] - px[i], ey = py[j] - py[i];
+        float edgeLenSq = ex * ex + ey * ey;
+        float edgeInv = edgeLenSq > 0.0f ? 1.0f / edgeLenSq : 0.0f;
+        if (cross2(ex, ey, ax - px[i], ay - py[i]) * area < 0.0f) aInside = false;
+        if (segmentsCross(ax, ay, bx, by, px[i], py[i], px[j], py[j])) return 0.0f;
+
+        best = std::min(best, segmentDistSq(px[i] - ax, py[i] - ay, dx, dy, invLenSq));
+        best = std::min(best, segmentDistSq(ax - px[i], ay - py[i], ex, ey, edgeInv));
+        best = std::min(best, segmentDistSq(bx - px[i], by - py[i], ex, ey, edgeInv));
+    }
+    // No edge crossed, so B is inside exactly when A is
+    return aInside ? 0.0f : best;
+}
+
+// Box centered at (cx, cy) with half extents (hx, hy)
+bool capsuleHitsBox(float ax, float ay, float bx, float by, float r, float cx, float cy, float hx, float hy) {
+    const float px[4] = { cx - hx, cx + hx, cx + hx, cx - hx };
+    const float py[4] = { cy - hy, cy - hy, cy + hy, cy + hy };
+    return segmentPolygonDistSq(px, py, 4, ax, ay, bx, by) < r * r;
+}
+
+// Uses the pieces from the last updatePlayerHitbox
+bool capsuleHitsPlayer(float ax, float ay, float bx, float by, float r) {
+    const PlayerHitbox& hb = playerHitbox;
+    if (!capsuleHitsBox(ax, ay, bx, by, r, hb.centerX, hb.centerY, hb.halfW, hb.halfH)) return false;
+    for (const auto& piece : hb.pieces) {
+        if (segmentPolygonDistSq(piece.x, piece.y, piece.count, ax, ay, bx, by) < r * r) return true;
+    }
+    return false;
+}
+
+// Rendering: one instanced draw of a unit strip, stretched over each beam's
+// capsule in the vertex shader and shaded with a soft edge, additively blended.
+// Without instancing (GL < 3.3) the same program draws one beam per call.
+struct BeamInstance {
+    float ax, ay, bx, by;
+    float radius;
+    float r, g, b, a;
+};
+
+GLuint beamProgram = 0;
+GLuint beamCornerBuffer = 0;
+GLuint beamInstanceBuffer = 0;
+bool beamInstancing = false;
+std::vector<BeamInstance> beamInstances;
+
+const char* beamVertexShader = R"(
+attribute vec2 corner;   // x: 0 at the start, 1 at the end; y: -1 to 1 across
+attribute vec4 segment;  // Start xy, end xy
+attribute float radius;
+attribute vec4 color;
+varying vec2 local;      // Along and across the beam, in radii from the start
+varying float beamLength;
+varying vec4 beamColor;
+
+void main() {
+    vec2 a = segment.xy;
+    vec2 b = segment.zw;
+    float len = length(b - a);
+    vec2 dir = len > 0.0 ? (b - a) / len : vec2(0.0, 1.0);
+    float along = mix(-radius, len + radius, corner.x);
+    vec2 p = a + dir * along + vec2(-dir.y, dir.x) * corner.y * radius;
+    local = vec2(along, corner.y * radius) / radius;
+    beamLength = len / radius;
+    beamColor = color;
+    gl_Position = worldToClip(p);
+}
+)";
+
+const char* beamFragmentShader = R"(
+#version 120
+varying vec2 local;
+varying float beamLength;
+varying vec4 beamColor;
+
+void main() {
+    float d = length(vec2(local.x - clamp(local.x, 0.0, beamLength), local.y)); // 1 at the capsule edge
+    float glow = 1.0 - smoothstep(0.0, 1.0, d);
+    float core = 1.0 - smoothstep(0.0, 0.35, d);
+    gl_FragColor = vec4(beamColor.rgb * glow + vec3(core), beamColor.a * glow);
+}
+)";
+
+void initBeamRenderer() {
+    if (!GLEW_VERSION_2_0) {
+        printf("Beams: no GLSL support, lasers are not drawn\n");
+        return;
+    }
+    const char* attributes[] = { "corner", "segment", "radius", "color", nullptr };
+    beamProgram = createWorldProgram(beamVertexShader, beamFragmentShader, attributes);
+    if (!beamProgram) return;
+
+    const GLfloat corners[] = { 0, -1, 1, -1, 0, 1, 1, 1 };
+    glGenBuffers(1, &beamCornerBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, beamCornerBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    beamInstancing = GLEW_VERSION_3_3;
+    if (beamInstancing) glGenBuffers(1, &beamInstanceBuffer);
+}
+
+void drawBeams() {
+    TRACE_SCOPE("drawBeams");
+    if (!beamProgram || beams.empty()) return;
+
+    // Warming up beams are a thin, faint telegraph of where they will fire
+    beamInstances.clear();
+    for (const auto& beam : beams) {
+        BeamInstance inst;
+        inst.ax = beam.x; inst.ay = beam.y;
+        beamEnd(beam, inst.bx, inst.by);
+        bool warming = beam.warmup > 0;
+        inst.radius = warming ? beam.radius * 0.25f : beam.radius;
+        if (beam.owner) { inst.r = 1.0f; inst.g = 0.2f; inst.b = 0.6f; }
+        else { inst.r = 0.3f; inst.g = 0.8f; inst.b = 1.0f; }
+        inst.a = warming ? 0.35f : 1.0f;
+        beamInstances.push_back(inst);
+    }
+
+    useWorldProgram(beamProgram);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    glBindBuffer(GL_ARRAY_BUFFER, beamCornerBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    if (beamInstancing) {
+        const GLsizei stride = sizeof(BeamInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, beamInstanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, beamInstances.size() * stride, beamInstances.data(), GL_STREAM_DRAW);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(BeamInstance, ax));
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(BeamInstance, radius));
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(BeamInstance, r));
+        for (GLuint a = 1; a <= 3; ++a) {
+            glEnableVertexAttribArray(a);
+            glVertexAttribDivisor(a, 1);
+        }
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)beamInstances.size());
+        for (GLuint a = 1; a <= 3; ++a) {
+            glVertexAttribDivisor(a, 0);
+            glDisableVertexAttribArray(a);
+        }
+    }
+    else {
+        // Per-beam values as constant attributes
+        for (const auto& inst : beamInstances) {
+            glVertexAttrib4f(1, inst.ax, inst.ay, inst.bx, inst.by);
+            glVertexAttrib1f(2, inst.radius);
+            glVertexAttrib4f(3, inst.r, inst.g, inst.b, inst.a);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+    }
+
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDisable(GL_BLEND);
+    glUseProgram(0);
+}
+
+// ------------------
+// Particles
+// ------------------
+// Sparks and explosions. Particles live in fixed-capacity SoA arrays and are
+// swap-removed when they expire. Gameplay code only enqueues bursts into a fixed
+// ring, which update expands into particles in bulk; when either is full, new
+// particles are dropped. The arrays go to the GPU as they are, one buffer block
+// per attribute, and draw as a single instanced quad with additive blending.
+const size_t PARTICLE_CAPACITY = 1 << 16;
+const size_t PARTICLE_BURST_CAPACITY = 1024;
+
+struct ParticleStyle {
+    int count;
+    float speedMin, speedMax; // Per tick
+    int lifeMin, lifeMax;     // Ticks
+    float size;               // Half width of the quad
+    float drag;               // Velocity factor per tick
+    uint32_t color;           // RGBA, red in the low byte
+};
+
+const ParticleStyle SPARK_STYLE        = { 6,    0.004f, 0.020f,  8, 18, 0.012f, 0.86f, 0xff40d0ffu };
+const ParticleStyle CANCEL_STYLE       = { 2,    0.002f, 0.008f,  6, 12, 0.010f, 0.90f, 0xff3030ffu };
+const ParticleStyle PLAYER_DEATH_STYLE = { 400,  0.002f, 0.030f, 20, 60, 0.018f, 0.94f, 0xff60ff40u };
+const ParticleStyle ENEMY_DEATH_STYLE  = { 3000, 0.002f, 0.045f, 30, 90, 0.020f, 0.95f, 0xffcc3399u };
+
+struct ParticleBurst {
+    float x, y;
+    const ParticleStyle* style;
+};
+
+class ParticleSystem {
+public:
+    // First count entries are live
+    std::vector<float> x, y, vx, vy, drag;
+    std::vector<float> life, invLife, alpha, size;
+    std::vector<uint32_t> color;
+    size_t count = 0;
+    uint64_t dropped = 0;
+    bool muted = false; // Set while rollback re-simulates ticks whose effects already played
+
+    ParticleSystem() {
+        x.resize(PARTICLE_CAPACITY); y.resize(PARTICLE_CAPACITY);
+        vx.resize(PARTICLE_CAPACITY); vy.resize(PARTICLE_CAPACITY); drag.resize(PARTICLE_CAPACITY);
+        life.resize(PARTICLE_CAPACITY); invLife.resize(PARTICLE_CAPACITY);
+        alpha.resize(PARTICLE_CAPACITY); size.resize(PARTICLE_CAPACITY);
+        color.resize(PARTICLE_CAPACITY);
+        bursts.resize(PARTICLE_BURST_CAPACITY);
+    }
+
+    // Cheap enough to call per hit: a few words into the ring
+    void enqueue(float px, float py, const ParticleStyle& style) {
+        if (muted) return;
+        if (burstCount == PARTICLE_BURST_CAPACITY) { dropped += style.count; return; }
+        bursts[(burstHead + burstCount++) % PARTICLE_BURST_CAPACITY] = { px, py, &style };
+    }
+
+    // One tick: expand queued bursts, integrate everything, then drop the expired
+    void update() {
+        TICK_PHASE(PHASE_PARTICLES);
+        for (; burstCount > 0; --burstCount) {
+            spawn(bursts[burstHead]);
+            burstHead = (burstHead + 1) % PARTICLE_BURST_CAPACITY;
+        }
+        integrate();
+        for (size_t i = 0; i < count;) {
+            if (life[i] <= 0.0f) removeAt(i);
+            else ++i;
+        }
+    }
+
+    void clear() {
+        count = 0;
+        burstHead = burstCount = 0;
+    }
+
+    void seed(uint64_t value) { rng.seed(value, RNG_PARTICLES); }
+
+private:
+    std::vector<ParticleBurst> bursts;
+    size_t burstHead = 0, burstCount = 0;
+    Rng rng{ RNG_PARTICLES };
+    std::vector<float> randomAngle, randomSpeed, randomLife, randomSize; // Per burst
+
+    // The burst's random values come from four batch fills, then one pass fills the slots
+    void spawn(const ParticleBurst& b) {
+        const ParticleStyle& st = *b.style;
+        size_t n = std::min((size_t)st.count, PARTICLE_CAPACITY - count);
+        dropped += st.count - n;
+        randomAngle.resize(n); randomSpeed.resize(n); randomLife.resize(n); randomSize.resize(n);
+        rng.fillUniform(randomAngle.data(), n, 0.0f, 2 * PI);
+        rng.fillUniform(randomSpeed.data(), n, st.speedMin, st.speedMax);
+        rng.fillUniform(randomLife.data(), n, 0.0f, (float)(st.lifeMax - st.lifeMin + 1));
+        rng.fillUniform(randomSize.data(), n, 0.5f * st.size, 1.5f * st.size);
+        for (size_t k = 0; k < n; ++k) {
+            size_t i = count + k;
+            float ticks = (float)(st.lifeMin + (int)randomLife[k]);
+            x[i] = b.x; y[i] = b.y;
+            vx[i] = std::cos(randomAngle[k]) * randomSpeed[k];
+            vy[i] = std::sin(randomAngle[k]) * randomSpeed[k];
+            drag[i] = st.drag;
+            life[i] = ticks;
+            invLife[i] = 1.0f / ticks;
+            alpha[i] = 1.0f;
+            size[i] = randomSize[k];
+            color[i] = st.color;
+        }
+        count += n;
+    }
+
+    // Position, velocity with drag, remaining life and fade, 8 or 4 particles at a time
+    void integrate() {
+        size_t i = 0;
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+        const __m256 one = _mm256_set1_ps(1.0f);
+        for (; i + 8 <= count; i += 8) {
+            __m256 pvx = _mm256_loadu_ps(&vx[i]), pvy = _mm256_loadu_ps(&vy[i]), d = _mm256_loadu_ps(&drag[i]);
+            _mm256_storeu_ps(&x[i], _mm256_add_ps(_mm256_loadu_ps(&x[i]), pvx));
+            _mm256_storeu_ps(&y[i], _mm256_add_ps(_mm256_loadu_ps(&y[i]), pvy));
+            _mm256_storeu_ps(&vx[i], _mm256_mul_ps(pvx, d));
+            _mm256_storeu_ps(&vy[i], _mm256_mul_ps(pvy, d));
+            __m256 l = _mm256_sub_ps(_mm256_loadu_ps(&life[i]), one);
+            _mm256_storeu_ps(&life[i], l);
+            _mm256_storeu_ps(&alpha[i], _mm256_mul_ps(l, _mm256_loadu_ps(&invLife[i])));
+        }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+        const __m128 one = _mm_set1_ps(1.0f);
+        for (; i + 4 <= count; i += 4) {
+            __m128 pvx = _mm_loadu_ps(&vx[i]), pvy = _mm_loadu_ps(&vy[i]), d = _mm_loadu_ps(&drag[i]);
+            _mm_storeu_ps(&x[i], _mm_add_ps(_mm_loadu_ps(&x[i]), pvx));
+            _mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), pvy));
+            _mm_storeu_ps(&vx[i], _mm_mul_ps(pvx, d));
+            _mm_storeu_ps(&vy[i], _mm_mul_ps(pvy, d));
+            __m128 l = _mm_sub_ps(_mm_loadu_ps(&life[i]), one);
+            _mm_storeu_ps(&life[i], l);
+            _mm_storeu_ps(&alpha[i], _mm_mul_ps(l, _mm_loadu_ps(&invLife[i])));
+        }
+#endif
+        // Scalar fallback and tail
+        for (; i < count; ++i) {
+            x[i] += vx[i];
+            y[i] += vy[i];
+            vx[i] *= drag[i];
+            vy[i] *= drag[i];
+            life[i] -= 1.0f;
+            alpha[i] = life[i] * invLife[i];
+        }
+    }
+
+    // Swap-remove: the last particle moves into i
+    void removeAt(size_t i) {
+        size_t last = --count;
+        x[i] = x[last]; y[i] = y[last]; vx[i] = vx[last]; vy[i] = vy[last]; drag[i] = drag[last];
+        life[i] = life[last]; invLife[i] = invLife[last]; alpha[i] = alpha[last]; size[i] = size[last];
+        color[i] = color[last];
+    }
+};
+
+ParticleSystem particles;
+
+// Rendering: the instance buffer holds one block per attribute, each PARTICLE_CAPACITY
+// long, so the SoA arrays upload without repacking. Without instancing (GL < 3.3)
+// particles fall back to immediate-mode points.
+enum ParticleBlock { PARTICLE_X, PARTICLE_Y, PARTICLE_SIZE, PARTICLE_ALPHA, PARTICLE_COLOR, PARTICLE_BLOCKS };
+
+GLuint particleProgram = 0;
+GLuint particleCornerBuffer = 0;
+GLuint particleInstanceBuffer = 0;
+
+const char* particleVertexShader = R"(
+attribute vec2 corner;  // -1 to 1
+attribute float centerX;
+attribute float centerY;
+attribute float size;
+attribute float alpha;
+attribute vec4 color;
+varying vec2 local;
+varying vec4 tint;
+
+void main() {
+    local = corner;
+    tint = vec4(color.rgb, color.a * alpha);
+    gl_Position = worldToClip(vec2(centerX, centerY) + corner * size);
+}
+)";
+
+const char* particleFragmentShader = R"(
+#version 120
+varying vec2 local;
+varying vec4 tint;
+
+void main() {
+    gl_FragColor = vec4(tint.rgb, tint.a * (1.0 - smoothstep(0.3, 1.0, length(local))));
+}
+)";
+
+void initParticleRenderer() {
+    if (!GLEW_VERSION_3_3) return;
+    const char* attributes[] = { "corner", "centerX", "centerY", "size", "alpha", "color", nullptr };
+    particleProgram = createWorldProgram(particleVertexShader, particleFragmentShader, attributes);
+    if (!particleProgram) return;
+
+    const GLfloat corners[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+    glGenBuffers(1, &particleCornerBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, particleCornerBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &particleInstanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, particleInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, PARTICLE_BLOCKS * PARTICLE_CAPACITY * 4, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawParticles() {
+    TRACE_SCOPE("drawParticles");
+    const ParticleSystem& ps = particles;
+    if (ps.count == 0) return;
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+    if (!particleProgram) {
+        glPointSize(3.0f);
+        glBegin(GL_POINTS);
+        for (size_t i = 0; i < ps.count; ++i) {
+            const uint8_t* c = (const uint8_t*)&ps.color[i];
+            glColor4ub(c[0], c[1], c[2], (GLubyte)(c[3] * ps.alpha[i]));
+            glVertex2f(ps.x[i], ps.y[i]);
+        }
+        glEnd();
+        glDisable(GL_BLEND);
+        return;
+    }
+
+    // Orphan the buffer, then one upload per SoA array
+    const size_t block = PARTICLE_CAPACITY * 4;
+    const size_t bytes = ps.count * 4;
+    glBindBuffer(GL_ARRAY_BUFFER, particleInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, PARTICLE_BLOCKS * block, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, PARTICLE_X * block, bytes, ps.x.data());
+    glBufferSubData(GL_ARRAY_BUFFER, PARTICLE_Y * block, bytes, ps.y.data());
+    glBufferSubData(GL_ARRAY_BUFFER, PARTICLE_SIZE * block, bytes, ps.size.data());
+    glBufferSubData(GL_ARRAY_BUFFER, PARTICLE_ALPHA * block, bytes, ps.alpha.data());
+    glBufferSubData(GL_ARRAY_BUFFER, PARTICLE_COLOR * block, bytes, ps.color.data());
+
+    useWorldProgram(particleProgram);
+    for (GLuint a = 1; a <= PARTICLE_BLOCKS; ++a) {
+        GLuint b = a - 1;
+        if (b == PARTICLE_COLOR) glVertexAttribPointer(a, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (const void*)(b * block));
+        else glVertexAttribPointer(a, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(b * block));
+        glEnableVertexAttribArray(a);
+        glVertexAttribDivisor(a, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, particleCornerBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(0);
+
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)ps.count);
+
+    for (GLuint a = 0; a <= PARTICLE_BLOCKS; ++a) {
+        glVertexAttribDivisor(a, 0);
+        glDisableVertexAttribArray(a);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+    glDisable(GL_BLEND);
+}
+
+// ------------------
+// Trails
+// ------------------
+// Motion trails on player shots and enemy lasers. The last TRAIL_LENGTH positions
+// of every trail live in one SoA ring indexed by slot (the handle index, which
+// stays put across swap-removes), so memory is fixed and recording is a store.
+// All rings share the write position, head. Each slot keeps a copy of sample 0
+// after its last sample, so segment r always joins r and r + 1: drawn as one
+// instanced quad per segment, expanded into a tapered ribbon in the vertex shader.
+const int TRAIL_LENGTH = 6;
+const int TRAIL_STRIDE = TRAIL_LENGTH + 1;
+const uint32_t TRAIL_SHOT_SLOTS = 1024;  // Player bullet slots beyond this get no trail
+const uint32_t TRAIL_BEAM_SLOTS = 64;
+const uint32_t TRAIL_SLOTS = TRAIL_SHOT_SLOTS + TRAIL_BEAM_SLOTS;
+const float TRAIL_BEAM_REACH = 0.8f; // A laser's trail follows this point along it, tracing the sweep
+
+enum TrailStyle { TRAIL_SHOT, TRAIL_BEAM };
+
+struct TrailHistory {
+    std::vector<float> x, y;     // TRAIL_SLOTS * TRAIL_STRIDE
+    std::vector<float> info;     // Per slot: valid samples (0: no trail), style
+    std::vector<Handle> owner;   // Handle that last wrote the slot, so a reused slot restarts
+    std::vector<int> startTick, lastTick;
+    int head = 0;
+    int tick = -1;
+    uint32_t usedSlots = 0;      // One past the highest slot recorded this tick
+    bool muted = false;          // Set while rollback re-simulates ticks already recorded
+
+    TrailHistory() {
+        x.resize(TRAIL_SLOTS * TRAIL_STRIDE); y.resize(TRAIL_SLOTS * TRAIL_STRIDE);
+        info.resize(2 * TRAIL_SLOTS);
+        owner.resize(TRAIL_SLOTS, INVALID_HANDLE);
+        startTick.resize(TRAIL_SLOTS, -1); lastTick.resize(TRAIL_SLOTS, -1);
+    }
+
+    // The same tick again (the newest one a rollback re-ran): take back what it
+    // recorded, and record over its samples
+    void begin(int t) {
+        if (t == tick) {
+            for (uint32_t slot = 0; slot < usedSlots; ++slot) {
+                if (lastTick[slot] == tick) lastTick[slot] = startTick[slot] < tick ? tick - 1 : -1;
+            }
+        }
+        else head = (head + 1) % TRAIL_LENGTH;
+        tick = t;
+        usedSlots = 0;
+    }
+
+    void record(uint32_t slot, Handle h, TrailStyle style, float px, float py) {
+        if (owner[slot] != h || lastTick[slot] != tick - 1) {
+            owner[slot] = h;
+            startTick[slot] = tick;
+        }
+        lastTick[slot] = tick;
+        size_t base = (size_t)slot * TRAIL_STRIDE;
+        x[base + head] = px; y[base + head] = py;
+        if (head == 0) { x[base + TRAIL_LENGTH] = px; y[base + TRAIL_LENGTH] = py; }
+        info[2 * slot] = (float)std::min(TRAIL_LENGTH, tick - startTick[slot] + 1);
+        info[2 * slot + 1] = (float)style;
+        usedSlots = std::max(usedSlots, slot + 1);
+    }
+
+    // Hides the slots nobody recorded this tick
+    void finish() {
+        for (uint32_t slot = 0; slot < usedSlots; ++slot) {
+            if (lastTick[slot] != tick) info[2 * slot] = 0.0f;
+        }
+    }
+
+    void clear() {
+        std::fill(lastTick.begin(), lastTick.end(), -1);
+        usedSlots = 0;
+    }
+};
+
+TrailHistory trails;
+
+// After collisions, so only surviving shots and beams are recorded
+void recordTrails() {
+    TICK_PHASE(PHASE_TRAILS);
+    playerBullets.ensurePositions(simTick); // Even when muted: evaluated positions are part of a snapshot
+    if (trails.muted) return;
+    trails.begin(simTick);
+    for (size_t i = 0; i < playerBullets.size(); ++i) {
+        Handle h = playerBullets.handleAt(i);
+        uint32_t slot = handleIndex(h);
+        if (slot < TRAIL_SHOT_SLOTS) trails.record(slot, h, TRAIL_SHOT, playerBullets.x[i], playerBullets.y[i]);
+    }
+    for (size_t i = 0; i < beams.size(); ++i) {
+        const Beam& beam = beams[i];
+        Handle h = beams.handleAt(i);
+        uint32_t slot = handleIndex(h);
+        if (!beam.owner || beam.warmup > 0 || slot >= TRAIL_BEAM_SLOTS) continue;
+        trails.record(TRAIL_SHOT_SLOTS + slot, h, TRAIL_BEAM,
+            beam.x + std::cos(beam.angle) * TRAIL_BEAM_REACH, beam.y + std::sin(beam.angle) * TRAIL_BEAM_REACH);
+    }
+    trails.finish();
+}
+
+// Instance buffer blocks: x and y rings, then per-slot info
+enum TrailBlock { TRAIL_X, TRAIL_Y, TRAIL_INFO };
+
+GLuint trailProgram = 0;
+GLuint trailCornerBuffer = 0;
+GLuint trailRingBuffer = 0;     // Static: ring index of each instance
+GLuint trailInstanceBuffer = 0;
+GLint trailHeadLocation = -1;
+
+const char* trailVertexShader = R"(
+attribute vec2 corner;   // x: 0 at the older sample, 1 at the newer; y: -1 to 1 across
+attribute float ring;    // Ring index of the older sample
+attribute float fromX;
+attribute float fromY;
+attribute float toX;
+attribute float toY;
+attribute vec2 info;     // Valid samples, style
+uniform float head;      // Ring index of the newest samples
+uniform float trailLength;
+varying vec4 tint;
+
+void main() {
+    // The segment leaving the newest sample would close the ring: never drawn
+    float age = mod(head - ring + trailLength, trailLength);
+    bool valid = ring < trailLength && age >= 1.0 && age < info.x;
+
+    vec2 a = vec2(fromX, fromY);
+    vec2 b = vec2(toX, toY);
+    vec2 d = b - a;
+    float len = length(d);
+    vec2 n = len > 0.0 ? vec2(-d.y, d.x) / len : vec2(0.0);
+    float fade = 1.0 - (age - corner.x) / trailLength;
+    bool beam = info.y > 0.5;
+    float width = (beam ? 0.012 : 0.007) * fade;
+    vec2 p = mix(a, b, corner.x) + n * corner.y * width;
+    tint = beam ? vec4(1.0, 0.3, 0.7, 0.5 * fade) : vec4(1.0, 1.0, 0.4, 0.6 * fade);
+    gl_Position = valid ? worldToClip(p) : vec4(2.0, 2.0, 2.0, 1.0);
+}
+)";
+
+const char* trailFragmentShader = R"(
+#version 120
+varying vec4 tint;
+
+void main() {
+    gl_FragColor = tint;
+}
+)";
+
+void initTrailRenderer() {
+    if (!GLEW_VERSION_3_3) return; // Trails need instancing
+    const char* attributes[] = { "corner", "ring", "fromX", "fromY", "toX", "toY", "info", nullptr };
+    trailProgram = createWorldProgram(trailVertexShader, trailFragmentShader, attributes);
+    if (!trailProgram) return;
+    trailHeadLocation = glGetUniformLocation(trailProgram, "head");
+    glUseProgram(trailProgram);
+    glUniform1f(glGetUniformLocation(trailProgram, "trailLength"), (float)TRAIL_LENGTH);
+    glUseProgram(0);
+
+    const GLfloat corners[] = { 0, -1, 1, -1, 0, 1, 1, 1 };
+    glGenBuffers(1, &trailCornerBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, trailCornerBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+    std::vector<float> ring(TRAIL_SLOTS * TRAIL_STRIDE);
+    for (size_t i = 0; i < ring.size(); ++i) ring[i] = (float)(i % TRAIL_STRIDE);
+    glGenBuffers(1, &trailRingBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, trailRingBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ring.size() * 4, ring.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &trailInstanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, trailInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, (2 * TRAIL_STRIDE + 2) * TRAIL_SLOTS * 4, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawTrails() {
+    TRACE_SCOPE("drawTrails");
+    const TrailHistory& th = trails;
+    if (!trailProgram || th.usedSlots == 0) return;
+
+    const size_t ringBlock = TRAIL_SLOTS * TRAIL_STRIDE * 4;
+    const size_t ringBytes = th.usedSlots * TRAIL_STRIDE * 4;
+    const size_t infoOffset = 2 * ringBlock;
+    glBindBuffer(GL_ARRAY_BUFFER, trailInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, infoOffset + 2 * TRAIL_SLOTS * 4, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, TRAIL_X * ringBlock, ringBytes, th.x.data());
+    glBufferSubData(GL_ARRAY_BUFFER, TRAIL_Y * ringBlock, ringBytes, th.y.data());
+    glBufferSubData(GL_ARRAY_BUFFER, infoOffset, th.usedSlots * 2 * 4, th.info.data());
+
+    useWorldProgram(trailProgram);
+    glUniform1f(trailHeadLocation, (float)th.head);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+    // Segment i reads ring entries i and i + 1; slot info advances once per slot
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(TRAIL_X * ringBlock));
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(TRAIL_Y * ringBlock));
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(TRAIL_X * ringBlock + 4));
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(TRAIL_Y * ringBlock + 4));
+    glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, 0, (const void*)infoOffset);
+    glBindBuffer(GL_ARRAY_BUFFER, trailRingBuffer);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+    for (GLuint a = 1; a <= 6; ++a) {
+        glEnableVertexAttribArray(a);
+        glVertexAttribDivisor(a, a == 6 ? TRAIL_STRIDE : 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, trailCornerBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(0);
+
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)(th.usedSlots * TRAIL_STRIDE));
+
+    for (GLuint a = 0; a <= 6; ++a) {
+        glVertexAttribDivisor(a, 0);
+        glDisableVertexAttribArray(a);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDisable(GL_BLEND);
+    glUseProgram(0);
+}
+
+// ------------------
+// Background
+// ------------------
+// Parallax starfield. Each layer is generated once into a static vertex buffer of
+// (x, y, brightness) in the unit square; the vertex shader scrolls and wraps it, so
+// a frame costs a few uniforms and one draw per layer whatever the star count.
+struct StarLayer {
+    int count;
+    float speed;     // Window heights per second
+    float parallax;  // Horizontal shift per unit of player x
+    float pointSize;
+    float r, g, b;
+    GLuint buffer;
+};
+
+StarLayer starLayers[] = {
+    { 600000, 0.010f, 0.01f, 1.0f, 0.35f, 0.35f, 0.45f, 0 },
+    { 250000, 0.025f, 0.02f, 1.0f, 0.55f, 0.55f, 0.65f, 0 },
+    { 120000, 0.060f, 0.04f, 1.5f, 0.75f, 0.75f, 0.80f, 0 },
+    {  30000, 0.140f, 0.08f, 2.0f, 1.00f, 1.00f, 1.00f, 0 },
+};
+
+GLuint starProgram = 0;
+GLint starScrollLocation = -1;
+GLint starTintLocation = -1;
+
+const char* starVertexShader = R"(
+#version 120
+attribute vec3 star;  // x, y in [0, 1), brightness
+uniform vec2 scroll;  // Layer offset in [0, 1)
+uniform vec3 tint;
+varying vec3 color;
+
+void main() {
+    vec2 p = fract(star.xy - scroll) * 2.0 - 1.0;
+    color = tint * star.z;
+    gl_Position = gl_ProjectionMatrix * vec4(p, 0.0, 1.0); // Far away: the camera does not move it
+}
+)";
+
+const char* starFragmentShader = R"(
+#version 120
+varying vec3 color;
+
+void main() {
+    gl_FragColor = vec4(color, 1.0);
+}
+)";
+
+void initBackground() {
+    if (!GLEW_VERSION_2_0) return; // Plain black without shaders
+    const char* attributes[] = { "star", nullptr };
+    starProgram = createProgram(starVertexShader, starFragmentShader, attributes);
+    if (!starProgram) return;
+    starScrollLocation = glGetUniformLocation(starProgram, "scroll");
+    starTintLocation = glGetUniformLocation(starProgram, "tint");
+
+    // Fixed seed, not rngSeed: the same sky every run
+    Rng sky;
+    sky.seed(0x2545f491u, RNG_BACKGROUND);
+
+    std::vector<float> stars, position, brightness;
+    for (auto& layer : starLayers) {
+        size_t n = (size_t)layer.count;
+        stars.resize(3 * n);
+        position.resize(2 * n);
+        brightness.resize(n);
+        sky.fillUniform(position.data(), 2 * n, 0.0f, 1.0f);
+        sky.fillUniform(brightness.data(), n, 0.0f, 1.0f);
+        for (size_t i = 0; i < n; ++i) {
+            float b = brightness[i];
+            stars[3 * i] = position[2 * i];
+            stars[3 * i + 1] = position[2 * i + 1];
+            stars[3 * i + 2] = 0.3f + 0.7f * b * b; // Mostly dim, a few bright
+        }
+        glGenBuffers(1, &layer.buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, layer.buffer);
+        glBufferData(GL_ARRAY_BUFFER, stars.size() * sizeof(float), stars.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawBackground() {
+    TRACE_SCOPE("drawBackground");
+    if (!starProgram) return;
+
+    // Wrapped in double on the CPU so the shader only ever sees offsets in [0, 1)
+    double seconds = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
+
+    glUseProgram(starProgram);
+    glEnableVertexAttribArray(0);
+    for (const auto& layer : starLayers) {
+        double sy = seconds * layer.speed;
+        double sx = playerX * layer.parallax;
+        glUniform2f(starScrollLocation, (float)(sx - std::floor(sx)), (float)(sy - std::floor(sy)));
+        glUniform3f(starTintLocation, layer.r, layer.g, layer.b);
+        glPointSize(layer.pointSize);
+        glBindBuffer(GL_ARRAY_BUFFER, layer.buffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glDrawArrays(GL_POINTS, 0, layer.count);
+    }
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glPointSize(1.0f);
+    glUseProgram(0);
+}
+
+// ------------------
+// GPU profiler
+// ------------------
+// GL_TIME_ELAPSED queries around each render pass. Every pass has a ring of
+// GPU_TIMER_LATENCY queries; a frame's results are read GPU_TIMER_LATENCY - 1 frames
+// later, and only once GL_QUERY_RESULT_AVAILABLE says so, so reading them never waits
+// on the GPU. A slot still pending when the ring comes back round is skipped for that
+// frame instead of being overwritten. Passes must not nest (one elapsed query at a time).
+enum GpuPass { GPU_PASS_SCENE, GPU_PASS_BRIGHT, GPU_PASS_DOWNSAMPLE, GPU_PASS_BLUR, GPU_PASS_COMPOSITE, GPU_PASS_COUNT };
+const char* gpuPassNames[GPU_PASS_COUNT] = { "scene", "bright", "downsample", "blur", "composite" };
+const int GPU_TIMER_LATENCY = 4;
+
+struct GpuPassTimer {
+    GLuint queries[GPU_TIMER_LATENCY];
+    bool issued[GPU_TIMER_LATENCY];
+    double lastMs, totalMs, maxMs;
+    long long samples;
+};
+
+struct GpuProfiler {
+    bool supported = false;
+    int frame = 0;
+    bool timing = false;     // A pass query is open (gpuPassBegin issued it)
+    GpuPassTimer passes[GPU_PASS_COUNT];
+    double frameMs = 0.0;    // All passes of the newest collected frame
+    bool frameReady = false; // Set with frameMs; the resolution manager takes it
+} gpuProfiler;
+
+void initGpuProfiler() {
+    gpuProfiler.supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (!gpuProfiler.supported) return;
+    for (auto& pass : gpuProfiler.passes) {
+        glGenQueries(GPU_TIMER_LATENCY, pass.queries);
+        for (bool& issued : pass.issued) issued = false;
+        pass.lastMs = pass.totalMs = pass.maxMs = 0.0;
+        pass.samples = 0;
+    }
+}
+
+void gpuPassBegin(GpuPass pass) {
+    if (!gpuProfiler.supported) return;
+    GpuPassTimer& t = gpuProfiler.passes[pass];
+    int slot = gpuProfiler.frame % GPU_TIMER_LATENCY;
+    if (t.issued[slot]) return; // Result not read yet; don't overwrite it
+    glBeginQuery(GL_TIME_ELAPSED, t.queries[slot]);
+    t.issued[slot] = true;
+    gpuProfiler.timing = true;
+}
+
+void gpuPassEnd() {
+    if (!gpuProfiler.timing) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    gpuProfiler.timing = false;
+}
+
+// Once per frame: collects finished slots oldest first, stopping at the first one
+// the GPU hasn't finished (it stays issued and is polled again next frame)
+void gpuProfilerFrame() {
+    if (!gpuProfiler.supported) return;
+    gpuProfiler.frame++;
+    for (int age = 0; age < GPU_TIMER_LATENCY; ++age) {
+        int slot = (gpuProfiler.frame + age) % GPU_TIMER_LATENCY;
+        bool pending = false, any = false;
+        for (auto& t : gpuProfiler.passes) {
+            if (!t.issued[slot]) continue;
+            any = true;
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(t.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) pending = true;
+        }
+        if (pending) break;
+        if (!any) continue;
+        double frameMs = 0.0;
+        for (auto& t : gpuProfiler.passes) {
+            if (!t.issued[slot]) continue;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(t.queries[slot], GL_QUERY_RESULT, &ns);
+            t.issued[slot] = false;
+            t.lastMs = ns / 1e6;
+            t.totalMs += t.lastMs;
+            t.maxMs = std::max(t.maxMs, t.lastMs);
+            t.samples++;
+            frameMs += t.lastMs;
+        }
+        gpuProfiler.frameMs = frameMs;
+        gpuProfiler.frameReady = true;
+    }
+}
+
+// Averages since the last report, then starts over
+void printGpuProfile() {
+    if (!gpuProfiler.supported) {
+        printf("GPU profile: timer queries not supported\n");
+        return;
+    }
+    printf("GPU profile (ms):");
+    for (int i = 0; i < GPU_PASS_COUNT; ++i) {
+        GpuPassTimer& t = gpuProfiler.passes[i];
+        if (t.samples == 0) continue;
+        printf("  %s avg %.3f max %.3f", gpuPassNames[i], t.totalMs / t.samples, t.maxMs);
+        t.totalMs = t.maxMs = 0.0;
+        t.samples = 0;
+    }
+    printf("\n");
+}
+
+// ------------------
+// Frame pacing
+// ------------------
+// The simulation runs at a fixed 60 ticks per second; frames are paced by the
+// display. With swap control, glutSwapBuffers waits for vblank and each present is
+// timestamped after a glFinish, so the stamp is when the frame went out rather
+// than when it was queued. The first presents measure the refresh period. Near a
+// multiple of 60 Hz the swap interval is raised to match (120 Hz: 2) and every
+// present is exactly one tick, following the display's clock instead of ours. Other
+// rates (144 Hz) present every vblank and run ticks from an accumulator of present
+// time, snapped to whole refresh periods so measurement noise cannot move a tick
+// to the neighbouring frame. Without swap control a timer wakes against absolute
+// deadlines, so the tick rate does not drift the way a fixed 16 ms delay does.
+const double TICK_SECONDS = 1.0 / 60.0;
+const int PACE_CALIBRATION_FRAMES = 120; // The first quarter is skipped as warm-up
+const int PACE_MAX_CATCHUP = 4;          // Ticks per frame; longer stalls slow the game down
+const double PACE_STALL_SECONDS = 0.1;   // No present for this long (hidden window): tick by the clock
+const double PACE_SNAP_SECONDS = 0.002;
+const int PACE_BUCKET_US = 250;
+const int PACE_BUCKET_COUNT = 200; // Up to 50 ms
+
+enum PaceMode { PACE_TIMER, PACE_CALIBRATING, PACE_LOCKED, PACE_ACCUMULATE };
+const char* paceModeNames[] = { "timer", "calibrating", "vsync locked", "vsync accumulate" };
+
+// Present-to-present intervals since the last report
+struct FrameStats {
+    uint32_t intervals[PACE_BUCKET_COUNT] = {};
+    uint32_t ticksPerFrame[PACE_MAX_CATCHUP + 1] = {};
+    long long frames = 0;
+    long long missed = 0;  // Presents that slipped past their vblank
+    long long dropped = 0; // Ticks beyond PACE_MAX_CATCHUP, lost to game time
+    double total = 0.0, jitterSq = 0.0, maxMs = 0.0;
+};
+
+struct FramePacer {
+    bool vsync = true;
+    PaceMode mode = PACE_TIMER;
+    int swapInterval = 0;
+    double refreshHz = 0.0;
+    double period = TICK_SECONDS; // Expected present-to-present time
+    double accumulator = 0.0;
+    std::chrono::steady_clock::time_point lastPresent, lastWake;
+    bool presented = false; // Since the frame loop last ran ticks
+    int ticksDue = 1;
+    std::vector<double> calibration;
+    FrameStats stats;
+} pacer;
+
+bool setSwapInterval(int interval) {
+#ifdef _WIN32
+    if (WGLEW_EXT_swap_control) return wglSwapIntervalEXT(interval) != FALSE;
+#elif defined(__linux__)
+    if (GLXEW_EXT_swap_control) {
+        glXSwapIntervalEXT(glXGetCurrentDisplay(), glXGetCurrentDrawable(), interval);
+        return true;
+    }
+    if (GLXEW_MESA_swap_control) return glXSwapIntervalMESA(interval) == 0;
+#endif
+    return false;
+}
+
+// After the window and GLEW are up. Returns whether frames are paced by vsync
+bool initFramePacer() {
+    pacer.lastPresent = pacer.lastWake = std::chrono::steady_clock::now();
+    if (pacer.vsync && setSwapInterval(1)) {
+        pacer.mode = PACE_CALIBRATING;
+        pacer.swapInterval = 1;
+        return true;
+    }
+    if (pacer.vsync) printf("Frame pacing: no swap control extension, using a timer\n");
+    setSwapInterval(0);
+    pacer.mode = PACE_TIMER;
+    return false;
+}
+
+// Median of the calibration frames picks the mode. A rate no display has means the
+// driver ignored the swap interval, so the timer takes over
+void finishCalibration() {
+    std::vector<double>& samples = pacer.calibration;
+    samples.erase(samples.begin(), samples.begin() + samples.size() / 4);
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    pacer.refreshHz = 1.0 / samples[samples.size() / 2];
+    samples.clear();
+    samples.shrink_to_fit();
+
+    double multiple = std::round(pacer.refreshHz * TICK_SECONDS);
+    if (pacer.refreshHz < 30.0 || pacer.refreshHz > 500.0) {
+        printf("Frame pacing: presents at %.1f Hz, vsync seems off; using a timer\n", pacer.refreshHz);
+        setSwapInterval(0);
+        pacer.mode = PACE_TIMER;
+        pacer.period = TICK_SECONDS;
+        return;
+    }
+    if (multiple >= 1.0 && std::abs(pacer.refreshHz * TICK_SECONDS - multiple) < 0.05 * multiple) {
+        pacer.swapInterval = (int)multiple;
+        setSwapInterval(pacer.swapInterval);
+        pacer.mode = PACE_LOCKED;
+    }
+    else pacer.mode = PACE_ACCUMULATE;
+    pacer.period = pacer.swapInterval / pacer.refreshHz;
+    pacer.stats = FrameStats();
+    printf("Frame pacing: %.2f Hz display, %s, swap interval %d\n", pacer.refreshHz, paceModeNames[pacer.mode], pacer.swapInterval);
+}
+
+// Whole ticks in the accumulator, capped
+int takeTicks(double seconds) {
+    pacer.accumulator += seconds;
+    int ticks = (int)(pacer.accumulator / TICK_SECONDS);
+    pacer.accumulator -= ticks * TICK_SECONDS;
+    if (ticks > PACE_MAX_CATCHUP) {
+        pacer.stats.dropped += ticks - PACE_MAX_CATCHUP;
+        ticks = PACE_MAX_CATCHUP;
+    }
+    return ticks;
+}
+
+// Timer mode, and vsync mode while no frames are being presented
+int wallClockTicks() {
+    auto now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - pacer.lastWake).count();
+    pacer.lastWake = now;
+    return takeTicks(dt);
+}
+
+// Rounded up, so the timer never fires before the next tick is due
+int msUntilNextTick() {
+    return (int)std::ceil((TICK_SECONDS - pacer.accumulator) * 1000.0);
+}
+
+bool presentStalled() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - pacer.lastPresent).count() > PACE_STALL_SECONDS;
+}
+
+// Right after the swap: timestamps the present, records the interval, and works out
+// how many ticks the next frame runs
+void framePresented() {
+    if (pacer.mode != PACE_TIMER) glFinish();
+    auto now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - pacer.lastPresent).count();
+    pacer.lastPresent = pacer.lastWake = now;
+    pacer.presented = true;
+
+    int ticks = 1;
+    switch (pacer.mode) {
+    case PACE_TIMER:
+        break;
+    case PACE_CALIBRATING:
+        ticks = takeTicks(dt);
+        pacer.calibration.push_back(dt);
+        if ((int)pacer.calibration.size() == PACE_CALIBRATION_FRAMES) finishCalibration();
+        break;
+    case PACE_LOCKED:
+        ticks = std::min(std::max((int)std::round(dt / pacer.period), 1), PACE_MAX_CATCHUP);
+        break;
+    case PACE_ACCUMULATE: {
+        double frames = std::max(std::round(dt / pacer.period), 1.0);
+        ticks = takeTicks(std::abs(dt - frames * pacer.period) < PACE_SNAP_SECONDS ? frames * pacer.period : dt);
+        break;
+    }
+    }
+    pacer.ticksDue = ticks;
+
+    FrameStats& s = pacer.stats;
+    double ms = dt * 1000.0;
+    double deviation = ms - pacer.period * 1000.0;
+    s.intervals[std::min((int)(ms * 1000.0 / PACE_BUCKET_US), PACE_BUCKET_COUNT - 1)]++;
+    if (pacer.mode != PACE_TIMER) s.ticksPerFrame[std::min(ticks, PACE_MAX_CATCHUP)]++;
+    if (pacer.mode >= PACE_LOCKED && dt > 1.5 * pacer.period) s.missed++;
+    s.frames++;
+    s.total += ms;
+    s.jitterSq += deviation * deviation;
+    s.maxMs = std::max(s.maxMs, ms);
+}
+
+// Interval histogram since the last report, then starts over
+void printFramePacing() {
+    FrameStats& s = pacer.stats;
+    if (s.frames == 0) return;
+    auto percentile = [&](double p) {
+        long long target = (long long)std::ceil(p * s.frames), seen = 0;
+        for (int i = 0; i < PACE_BUCKET_COUNT; ++i) {
+            seen += s.intervals[i];
+            if (seen >= target) return (i + 1) * PACE_BUCKET_US / 1000.0;
+        }
+        return PACE_BUCKET_COUNT * PACE_BUCKET_US / 1000.0;
+    };
+    printf("Frame pacing: %s", paceModeNames[pacer.mode]);
+    if (pacer.refreshHz > 0.0) printf(", %.2f Hz display, swap interval %d", pacer.refreshHz, pacer.swapInterval);
+    printf(", %lld frames\n", s.frames);
+    printf("  interval: mean %.2f ms (target %.2f), jitter %.3f ms rms, p50 <%.2f ms, p99 <%.2f ms, max %.2f ms\n",
+        s.total / s.frames, pacer.period * 1000.0, std::sqrt(s.jitterSq / s.frames), percentile(0.5), percentile(0.99), s.maxMs);
+    if (pacer.mode != PACE_TIMER) {
+        printf("  missed vblanks %lld, dropped ticks %lld, ticks per frame:", s.missed, s.dropped);
+        for (int i = 0; i <= PACE_MAX_CATCHUP; ++i) printf(" %d%s:%u", i, i == PACE_MAX_CATCHUP ? "+" : "", s.ticksPerFrame[i]);
+        printf("\n");
+    }
+
+    // Buckets holding at least 0.1% of frames, bars scaled to the fullest
+    uint32_t fullest = *std::max_element(s.intervals, s.intervals + PACE_BUCKET_COUNT);
+    for (int i = 0; i < PACE_BUCKET_COUNT; ++i) {
+        if (s.intervals[i] * 1000 < s.frames) continue;
+        int bar = (int)std::ceil(40.0 * s.intervals[i] / fullest);
+        printf("  %6.2f ms %s%8u %s\n", i * PACE_BUCKET_US / 1000.0, i == PACE_BUCKET_COUNT - 1 ? "+" : " ", s.intervals[i], std::string(bar, '#').c_str());
+    }
+    s = FrameStats();
+}
+
+// ------------------
+// Resolution
+// ------------------
+// The playfield keeps the 4:3 shape it was designed at: on resize it becomes the
+// largest 4:3 rectangle centred in the window, with black bars around it. The world
+// is drawn into the scene target (see Bloom) at a fraction of the playfield's pixel
+// size, and the final pass stretches it over the playfield with bilinear filtering,
+// which it samples with anyway. With GPU timer queries the fraction follows a frame
+// time budget (a share of the frame period the pacer measured, or --frame-budget):
+// the median GPU time of a window of frames (a hitch is not a trend) over budget
+// shrinks the scale straight to the size whose pixel count fits, and a window well
+// under it grows one step. Steps are 1/16, so noise does not rebuild the targets. Without
+// timer queries, or with --render-scale, the scale stays where it is.
+const float PLAYFIELD_ASPECT = 4.0f / 3.0f;
+const float RENDER_SCALE_MIN = 0.5f;
+const float RENDER_SCALE_STEP = 1.0f / 16.0f;
+const int RESOLUTION_WINDOW_FRAMES = 20;
+const double RESOLUTION_BUDGET_SHARE = 0.8; // Of the frame period, when no budget is given
+const double RESOLUTION_HEADROOM = 0.75;    // Grow only while under this share of the budget
+
+struct Resolution {
+    int windowWidth = 800, windowHeight = 600;
+    int viewX = 0, viewY = 0, viewWidth = 800, viewHeight = 600; // Playfield, in window pixels
+    float scale = 1.0f;
+    bool dynamic = true;
+    double budgetMs = 0.0; // 0: from the frame period
+    double windowMs[RESOLUTION_WINDOW_FRAMES];
+    int windowFrames = -RESOLUTION_WINDOW_FRAMES; // Negative while startup or pre-change results drain
+
+    int renderWidth() const { return std::max(1, (int)std::lround(viewWidth * scale)); }
+    int renderHeight() const { return std::max(1, (int)std::lround(viewHeight * scale)); }
+} resolution;
+
+void reshape(int width, int height) {
+    Resolution& r = resolution;
+    r.windowWidth = std::max(width, 1);
+    r.windowHeight = std::max(height, 1);
+    r.viewWidth = r.windowWidth;
+    r.viewHeight = std::max((int)std::lround(r.windowWidth / PLAYFIELD_ASPECT), 1);
+    if (r.viewHeight > r.windowHeight) {
+        r.viewHeight = r.windowHeight;
+        r.viewWidth = std::max((int)std::lround(r.windowHeight * PLAYFIELD_ASPECT), 1);
+    }
+    r.viewX = (r.windowWidth - r.viewWidth) / 2;
+    r.viewY = (r.windowHeight - r.viewHeight) / 2;
+    glViewport(r.viewX, r.viewY, r.viewWidth, r.viewHeight);
+}
+
+// Once per frame, from the newest GPU timings
+void adjustRenderScale() {
+    Resolution& r = resolution;
+    if (!r.dynamic || !gpuProfiler.frameReady) return;
+    gpuProfiler.frameReady = false;
+    if (r.windowFrames < 0) {
+        r.windowFrames++;
+        return;
+    }
+    r.windowMs[r.windowFrames++] = gpuProfiler.frameMs;
+    if (r.windowFrames < RESOLUTION_WINDOW_FRAMES) return;
+
+    std::nth_element(r.windowMs, r.windowMs + RESOLUTION_WINDOW_FRAMES / 2, r.windowMs + RESOLUTION_WINDOW_FRAMES);
+    double gpuMs = r.windowMs[RESOLUTION_WINDOW_FRAMES / 2];
+    double budget = r.budgetMs > 0.0 ? r.budgetMs : pacer.period * 1000.0 * RESOLUTION_BUDGET_SHARE;
+    r.windowFrames = 0;
+
+    float next = r.scale;
+    if (gpuMs > budget) next = std::floor(r.scale * (float)std::sqrt(budget / gpuMs) / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+    else if (gpuMs < budget * RESOLUTION_HEADROOM) next = r.scale + RENDER_SCALE_STEP;
+    next = std::min(std::max(next, RENDER_SCALE_MIN), 1.0f);
+    if (next == r.scale) return;
+
+    printf("Resolution: render scale %g%% -> %g%% (GPU %.2f ms, budget %.2f ms)\n", r.scale * 100.0f, next * 100.0f, gpuMs, budget);
+    r.scale = next;
+    r.windowFrames = -GPU_TIMER_LATENCY;
+}
+
+// ------------------
+// Bloom
+// ------------------
+// The world is drawn into a scene texture at the render resolution. A bright pass
+// writes the glowing parts at reduced resolution, which is halved again into a short
+// mip chain; each level is blurred with a separable 9-tap Gaussian that takes 5
+// fetches per direction (pairs of taps merged into one linear fetch between them),
+// and the composite adds every level back over the scene. At full scale it writes
+// the playfield directly; scaled down, it runs at render size and a one-fetch copy
+// stretches the result, so the six-texture pass does not pay for window pixels.
+// With bloom off the scene is only stretched. Needs FBOs; otherwise
+// the scene is drawn straight to the window at full resolution.
+const int BLOOM_MAX_LEVELS = 5;
+
+struct BloomQuality {
+    const char* name;
+    int divisor; // First level resolution: window / divisor
+    int levels;
+};
+
+const BloomQuality bloomQualities[] = {
+    { "off",    0, 0 },
+    { "low",    4, 2 },
+    { "medium", 2, 3 },
+    { "high",   2, 5 },
+};
+const int BLOOM_QUALITY_COUNT = sizeof(bloomQualities) / sizeof(bloomQualities[0]);
+
+struct BloomTarget {
+    GLuint texture = 0, fbo = 0;
+    int width = 0, height = 0;
+};
+
+struct Bloom {
+    bool supported = false;
+    int quality = 2;
+    float threshold = 0.45f;
+    float intensity = 0.9f;
+
+    // Built for this render size and quality
+    int width = 0, height = 0, builtQuality = -1;
+    BloomTarget scene;
+    BloomTarget resolved; // Composite at render size, when that is below the playfield's
+    BloomTarget levels[BLOOM_MAX_LEVELS][2]; // Result, blur scratch
+    int levelCount = 0;
+
+    GLuint quadBuffer = 0;
+    GLuint brightProgram = 0, copyProgram = 0, blurProgram = 0, compositeProgram = 0;
+    GLint thresholdLocation = -1, blurStepLocation = -1, intensityLocation = -1, weightsLocation = -1;
+    bool active = false; // Scene target bound this frame
+} bloom;
+
+const char* postVertexShader = R"(
+#version 120
+attribute vec2 corner;
+varying vec2 uv;
+
+void main() {
+    uv = corner * 0.5 + 0.5;
+    gl_Position = vec4(corner, 0.0, 1.0);
+}
+)";
+
+// The bright pass renders at half size or less, so its one linear fetch already averages 2x2 texels
+const char* brightFragmentShader = R"(
+#version 120
+uniform sampler2D source;
+uniform float threshold;
+varying vec2 uv;
+
+void main() {
+    vec3 c = texture2D(source, uv).rgb;
+    float peak = max(c.r, max(c.g, c.b));
+    gl_FragColor = vec4(c * (max(peak - threshold, 0.0) / max(peak, 0.0001)), 1.0);
+}
+)";
+
+const char* copyFragmentShader = R"(
+#version 120
+uniform sampler2D source;
+varying vec2 uv;
+
+void main() {
+    gl_FragColor = texture2D(source, uv);
+}
+)";
+
+// 9-tap Gaussian (binomial weights) as 5 fetches: taps 1-2 and 3-4 on each side are
+// merged into one fetch at their weighted offset
+const char* blurFragmentShader = R"(
+#version 120
+uniform sampler2D source;
+uniform vec2 blurStep; // One texel along the blur direction
+varying vec2 uv;
+
+void main() {
+    vec3 c = texture2D(source, uv).rgb * 0.2270270270;
+    vec2 o1 = blurStep * 1.3846153846;
+    vec2 o2 = blurStep * 3.2307692308;
+    c += (texture2D(source, uv + o1).rgb + texture2D(source, uv - o1).rgb) * 0.3162162162;
+    c += (texture2D(source, uv + o2).rgb + texture2D(source, uv - o2).rgb) * 0.0702702703;
+    gl_FragColor = vec4(c, 1.0);
+}
+)";
+
+const char* compositeFragmentShader = R"(
+#version 120
+uniform sampler2D scene;
+uniform sampler2D level0;
+uniform sampler2D level1;
+uniform sampler2D level2;
+uniform sampler2D level3;
+uniform sampler2D level4;
+uniform float weights[5]; // 0 for unused levels
+uniform float intensity;
+varying vec2 uv;
+
+void main() {
+    vec3 glow = texture2D(level0, uv).rgb * weights[0] + texture2D(level1, uv).rgb * weights[1]
+              + texture2D(level2, uv).rgb * weights[2] + texture2D(level3, uv).rgb * weights[3]
+              + texture2D(level4, uv).rgb * weights[4];
+    gl_FragColor = vec4(texture2D(scene, uv).rgb + glow * intensity, 1.0);
+}
+)";
+
+void initBloom() {
+    bloom.supported = GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+    if (!bloom.supported) {
+        printf("Bloom: framebuffer objects not supported\n");
+        resolution.scale = 1.0f;
+        resolution.dynamic = false;
+        return;
+    }
+    const char* attributes[] = { "corner", nullptr };
+    bloom.brightProgram = createProgram(postVertexShader, brightFragmentShader, attributes);
+    bloom.copyProgram = createProgram(postVertexShader, copyFragmentShader, attributes);
+    bloom.blurProgram = createProgram(postVertexShader, blurFragmentShader, attributes);
+    bloom.compositeProgram = createProgram(postVertexShader, compositeFragmentShader, attributes);
+    if (!bloom.brightProgram || !bloom.copyProgram || !bloom.blurProgram || !bloom.compositeProgram) {
+        bloom.supported = false;
+        resolution.scale = 1.0f;
+        resolution.dynamic = false;
+        return;
+    }
+    bloom.thresholdLocation = glGetUniformLocation(bloom.brightProgram, "threshold");
+    bloom.blurStepLocation = glGetUniformLocation(bloom.blurProgram, "blurStep");
+    bloom.intensityLocation = glGetUniformLocation(bloom.compositeProgram, "intensity");
+    bloom.weightsLocation = glGetUniformLocation(bloom.compositeProgram, "weights");
+
+    // Texture units are fixed: scene on 0, levels on 1 to 5
+    const char* samplers[] = { "scene", "level0", "level1", "level2", "level3", "level4" };
+    glUseProgram(bloom.compositeProgram);
+    for (int i = 0; i < 6; ++i) glUniform1i(glGetUniformLocation(bloom.compositeProgram, samplers[i]), i);
+    glUseProgram(0);
+
+    const GLfloat corners[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+    glGenBuffers(1, &bloom.quadBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, bloom.quadBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void createBloomTarget(BloomTarget& t, int width, int height) {
+    t.width = std::max(1, width);
+    t.height = std::max(1, height);
+    glGenTextures(1, &t.texture);
+    glBindTexture(GL_TEXTURE_2D, t.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, t.width, t.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &t.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t.texture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void destroyBloomTarget(BloomTarget& t) {
+    if (t.fbo) glDeleteFramebuffers(1, &t.fbo);
+    if (t.texture) glDeleteTextures(1, &t.texture);
+    t = BloomTarget();
+}
+
+// Rebuilds the targets when the render size or quality changed
+void buildBloomTargets(int width, int height) {
+    if (width == bloom.width && height == bloom.height && bloom.quality == bloom.builtQuality) return;
+    destroyBloomTarget(bloom.scene);
+    destroyBloomTarget(bloom.resolved);
+    for (auto& level : bloom.levels) { destroyBloomTarget(level[0]); destroyBloomTarget(level[1]); }
+
+    const BloomQuality& q = bloomQualities[bloom.quality];
+    bloom.width = width;
+    bloom.height = height;
+    bloom.builtQuality = bloom.quality;
+    bloom.levelCount = q.levels;
+    createBloomTarget(bloom.scene, width, height);
+    if (q.levels == 0) return;
+    if (width < resolution.viewWidth || height < resolution.viewHeight) createBloomTarget(bloom.resolved, width, height);
+
+    int w = width / q.divisor, h = height / q.divisor;
+    for (int i = 0; i < q.levels; ++i) {
+        createBloomTarget(bloom.levels[i][0], w, h);
+        createBloomTarget(bloom.levels[i][1], w, h);
+        w /= 2;
+        h /= 2;
+    }
+}
+
+void drawPostQuad(GLuint program, const BloomTarget& dst, GLuint source) {
+    glBindFramebuffer(GL_FRAMEBUFFER, dst.fbo);
+    glViewport(0, 0, dst.width, dst.height);
+    glUseProgram(program);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+// Start of the frame: world drawing goes to the scene target at the render size
+void bloomBegin() {
+    bloom.active = false;
+    if (!bloom.supported) return;
+    buildBloomTargets(resolution.renderWidth(), resolution.renderHeight());
+    glBindFramebuffer(GL_FRAMEBUFFER, bloom.scene.fbo);
+    glViewport(0, 0, bloom.scene.width, bloom.scene.height);
+    bloom.active = true;
+}
+
+// Back to the window: clears the bars around the playfield and leaves the viewport on it
+void bindPlayfield() {
+    const Resolution& r = resolution;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, r.windowWidth, r.windowHeight);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glViewport(r.viewX, r.viewY, r.viewWidth, r.viewHeight);
+}
+
+// After the world is drawn: bright pass, downsample, blur, and composite onto the playfield
+void bloomEnd() {
+    TRACE_SCOPE("bloom");
+    if (!bloom.active) return;
+    bloom.active = false;
+
+    glBindBuffer(GL_ARRAY_BUFFER, bloom.quadBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(0);
+    glActiveTexture(GL_TEXTURE0);
+
+    if (bloom.levelCount == 0) {
+        gpuPassBegin(GPU_PASS_COMPOSITE);
+        bindPlayfield();
+        glUseProgram(bloom.copyProgram);
+        glBindTexture(GL_TEXTURE_2D, bloom.scene.texture);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        gpuPassEnd();
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDisableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+        return;
+    }
+
+    gpuPassBegin(GPU_PASS_BRIGHT);
+    glUseProgram(bloom.brightProgram);
+    glUniform1f(bloom.thresholdLocation, bloom.threshold);
+    drawPostQuad(bloom.brightProgram, bloom.levels[0][0], bloom.scene.texture);
+    gpuPassEnd();
+
+    gpuPassBegin(GPU_PASS_DOWNSAMPLE);
+    for (int i = 1; i < bloom.levelCount; ++i) {
+        drawPostQuad(bloom.copyProgram, bloom.levels[i][0], bloom.levels[i - 1][0].texture);
+    }
+    gpuPassEnd();
+
+    gpuPassBegin(GPU_PASS_BLUR);
+    glUseProgram(bloom.blurProgram);
+    for (int i = 0; i < bloom.levelCount; ++i) {
+        BloomTarget* level = bloom.levels[i];
+        glUniform2f(bloom.blurStepLocation, 1.0f / level[0].width, 0.0f);
+        drawPostQuad(bloom.blurProgram, level[1], level[0].texture);
+        glUniform2f(bloom.blurStepLocation, 0.0f, 1.0f / level[0].height);
+        drawPostQuad(bloom.blurProgram, level[0], level[1].texture);
+    }
+    gpuPassEnd();
+
+    // Coarser levels spread wider, so they are weighted down a little
+    gpuPassBegin(GPU_PASS_COMPOSITE);
+    GLfloat weights[BLOOM_MAX_LEVELS] = {};
+    for (int i = 0; i < BLOOM_MAX_LEVELS; ++i) {
+        int level = std::min(i, bloom.levelCount - 1);
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_2D, bloom.levels[level][0].texture);
+        if (i < bloom.levelCount) weights[i] = 1.0f / (1.0f + 0.5f * i);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(bloom.compositeProgram);
+    glUniform1fv(bloom.weightsLocation, BLOOM_MAX_LEVELS, weights);
+    glUniform1f(bloom.intensityLocation, bloom.intensity);
+    if (bloom.resolved.fbo) {
+        drawPostQuad(bloom.compositeProgram, bloom.resolved, bloom.scene.texture);
+        bindPlayfield();
+        glUseProgram(bloom.copyProgram);
+        glBindTexture(GL_TEXTURE_2D, bloom.resolved.texture);
+    }
+    else {
+        bindPlayfield();
+        glBindTexture(GL_TEXTURE_2D, bloom.scene.texture);
+    }
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    gpuPassEnd();
+
+    for (int i = 0; i < BLOOM_MAX_LEVELS; ++i) {
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void drawText(float x, float y, const std::string& text) {
+    TRACE_SCOPE("drawText");
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glRasterPos2f(x, y);
+    for (char c : text) {
+        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
+    }
+}
+
+// ------------------
+// Rollback
+// ------------------
+// Two-player versus, GGPO style. Each peer simulates only its own field: the
+// opponent reaches it through the garbage count in their input frames, so input
+// frames are all that cross the wire. Remote input is predicted (no garbage) and
+// the game runs ahead of it. When a remote frame arrives that contradicts the
+// prediction, the state saved before that tick is restored and every tick since
+// is re-simulated within the same frame. More than ROLLBACK_MAX_TICKS ahead of the
+// last confirmed remote frame, the session stalls until the peer catches up.
+const int ROLLBACK_MAX_TICKS = 8;
+// Enemy bullets per field in versus. A frame may re-simulate the whole window and
+// then run its own tick, snapshots included: at this count the median such frame
+// takes a sixth of the 16.7 ms budget (see --rollback-bench), at 50000 half of it
+// and its worst over 90%.
+const size_t ROLLBACK_MAX_BULLETS = 20000;
+const int ROLLBACK_STATE_SLOTS = 16;  // Power of two, > ROLLBACK_MAX_TICKS
+const int ROLLBACK_INPUT_SLOTS = 64;  // Power of two, covers both peers' windows plus latency
+const uint32_t ROLLBACK_PACKET_MAGIC = 0x4b4c4252; // "RBLK"
+
+// Unreliable datagrams; the session resends every unacknowledged input each frame
+class Transport {
+public:
+    virtual ~Transport() {}
+    virtual void send(const void* data, size_t bytes) = 0;
+    // Copies the next waiting datagram and returns its size, 0 when none is waiting
+    virtual size_t receive(void* data, size_t capacity) = 0;
+};
+
+// Non-blocking UDP socket talking to one peer, e.g. another instance on localhost
+class UdpTransport : public Transport {
+public:
+    ~UdpTransport() { close(); }
+
+    bool open(int localPort, const std::string& host, int port) {
+#ifdef _WIN32
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+        started = true;
+#endif
+        addrinfo hints = {}, * found = nullptr;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0 || !found) {
+            printf("Versus: unknown peer %s\n", host.c_str());
+            close();
+            return false;
+        }
+        memcpy(&peer, found->ai_addr, sizeof(peer));
+        freeaddrinfo(found);
+
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons((uint16_t)localPort);
+        if (!isOpen() || bind(sock, (const sockaddr*)&local, sizeof(local)) != 0) {
+            printf("Versus: can't bind UDP port %d\n", localPort);
+            close();
+            return false;
+        }
+
+        // Receive polls once per frame
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ioctlsocket(sock, FIONBIO, &nonBlocking);
+#else
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (isOpen()) closesocket(sock);
+        if (started) WSACleanup();
+        sock = INVALID_SOCKET;
+        started = false;
+#else
+        if (isOpen()) ::close(sock);
+        sock = -1;
+#endif
+    }
+
+    void send(const void* data, size_t bytes) override {
+        if (isOpen()) sendto(sock, (const char*)data, (int)bytes, 0, (const sockaddr*)&peer, sizeof(peer));
+    }
+
+    size_t receive(void* data, size_t capacity) override {
+        if (!isOpen()) return 0;
+        int n = (int)recvfrom(sock, (char*)data, (int)capacity, 0, nullptr, nullptr);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+private:
+#ifdef _WIN32
+    SOCKET sock = INVALID_SOCKET;
+    bool started = false;
+    bool isOpen() const { return sock != INVALID_SOCKET; }
+#else
+    int sock = -1;
+    bool isOpen() const { return sock >= 0; }
+#endif
+    sockaddr_in peer = {};
+};
+
+// Two in-process endpoints with simulated latency, jitter and loss, counted in
+// frames: call tick() on both once per frame. Runs sessions without a network.
+class LoopbackTransport : public Transport {
+public:
+    int latency = 0;    // Frames until delivery
+    int jitter = 0;     // Up to this many extra frames, so datagrams can reorder
+    float loss = 0.0f;  // Fraction dropped
+
+    static void connect(LoopbackTransport& a, LoopbackTransport& b) { a.peer = &b; b.peer = &a; }
+
+    void tick() { now++; }
+
+    void send(const void* data, size_t bytes) override {
+        if (!peer || rng.uniform() < loss) return;
+        int delay = latency + (jitter > 0 ? (int)(rng.uniform() * (jitter + 1)) : 0);
+        const uint8_t* p = (const uint8_t*)data;
+        peer->inbox.push_back({ peer->now + delay, std::vector<uint8_t>(p, p + bytes) });
+    }
+
+    size_t receive(void* data, size_t capacity) override {
+        for (auto it = inbox.begin(); it != inbox.end(); ++it) {
+            if (it->due > now) continue;
+            size_t n = std::min(capacity, it->bytes.size());
+            memcpy(data, it->bytes.data(), n);
+            inbox.erase(it);
+            return n;
+        }
+        return 0;
+    }
+
+private:
+    struct Datagram {
+        int due;
+        std::vector<uint8_t> bytes;
+    };
+
+    LoopbackTransport* peer = nullptr;
+    std::deque<Datagram> inbox;
+    int now = 0;
+    Rng rng{ RNG_LOOPBACK };
+};
+
+// Every local input the peer hasn't acknowledged, plus our own acknowledgement
+struct InputPacket {
+    uint32_t magic;
+    int32_t ack;    // Last remote frame the sender has, and all before it
+    int32_t first;  // Frame of inputs[0]
+    uint32_t count;
+    InputFrame inputs[ROLLBACK_INPUT_SLOTS];
+};
+
+class RollbackSession {
+public:
+    typedef void (*StepFunction)(const InputFrame& input, const InputFrame& opponent);
+
+    // Stats for the HUD and the benchmark
+    int rollbacks = 0, stalls = 0;
+    int lastRollback = 0, maxRollback = 0; // Ticks re-simulated
+
+    void start(Transport* t, StepFunction stepFunction) {
+        *this = RollbackSession();
+        transport = t;
+        step = stepFunction;
+    }
+
+    bool active() const { return transport != nullptr; }
+    int currentFrame() const { return frame; }
+    int confirmedFrame() const { return confirmed; }
+    const InputFrame& remoteInput(int f) const { return remote[f & (ROLLBACK_INPUT_SLOTS - 1)]; }
+
+    // State saved before frame f ran, while f is within the rollback window
+    const std::vector<uint8_t>& savedState(int f) const { return states[f & (ROLLBACK_STATE_SLOTS - 1)]; }
+
+    // One display frame: take in remote input, roll back to the first tick it
+    // contradicts, then run the next tick with this local input
+    void advance(const InputFrame& input) {
+        TRACE_SCOPE("rollback");
+        if (!transport) return;
+
+        int from = receive();
+        lastRollback = frame - from;
+        if (from < frame) {
+            restoreSnapshot(states[from & (ROLLBACK_STATE_SLOTS - 1)]);
+            // Trails keep what was shown, except the newest tick: it is re-recorded in place
+            particles.muted = true;
+            for (int f = from; f < frame; ++f) {
+                trails.muted = f + 1 < frame;
+                simulate(f);
+            }
+            trails.muted = false;
+            particles.muted = false;
+            rollbacks++;
+            maxRollback = std::max(maxRollback, lastRollback);
+        }
+
+        if (frame - confirmed > ROLLBACK_MAX_TICKS) stalls++;
+        else {
+            local[frame & (ROLLBACK_INPUT_SLOTS - 1)] = input;
+            simulate(frame++);
+        }
+        send();
+    }
+
+private:
+    Transport* transport = nullptr;
+    StepFunction step = nullptr;
+    int frame = 0;        // Next tick to simulate
+    int confirmed = -1;   // Last remote frame received, all earlier ones too
+    int remoteAck = -1;   // Last local frame the peer has
+    InputFrame local[ROLLBACK_INPUT_SLOTS];
+    InputFrame remote[ROLLBACK_INPUT_SLOTS];
+    InputFrame used[ROLLBACK_INPUT_SLOTS]; // Remote input each tick last ran with
+    std::vector<uint8_t> states[ROLLBACK_STATE_SLOTS];
+
+    // Confirmed input, else the last confirmed buttons without garbage
+    InputFrame predict(int f) const {
+        if (f <= confirmed) return remote[f & (ROLLBACK_INPUT_SLOTS - 1)];
+        InputFrame guess;
+        if (confirmed >= 0) guess.buttons = remote[confirmed & (ROLLBACK_INPUT_SLOTS - 1)].buttons;
+        return guess;
+    }
+
+    void simulate(int f) {
+        InputFrame& opponent = used[f & (ROLLBACK_INPUT_SLOTS - 1)];
+        opponent = predict(f);
+        saveSnapshot(states[f & (ROLLBACK_STATE_SLOTS - 1)]);
+        step(local[f & (ROLLBACK_INPUT_SLOTS - 1)], opponent);
+    }
+
+    // Drains the transport; returns the first frame whose prediction was wrong, or frame.
+    // Remote buttons never reach this field, so only a garbage mismatch costs a rollback.
+    int receive() {
+        int from = frame;
+        InputPacket p;
+        const size_t headerBytes = offsetof(InputPacket, inputs);
+        size_t bytes;
+        while ((bytes = transport->receive(&p, sizeof(p))) > 0) {
+            if (bytes < headerBytes || p.magic != ROLLBACK_PACKET_MAGIC || p.count > ROLLBACK_INPUT_SLOTS) continue;
+            if (bytes != headerBytes + p.count * sizeof(InputFrame)) continue;
+            remoteAck = std::max(remoteAck, (int)p.ack);
+            for (uint32_t i = 0; i < p.count; ++i) {
+                int f = p.first + (int)i;
+                if (f != confirmed + 1) continue; // Already have it, or past a gap a later packet fills
+                if (f - frame >= ROLLBACK_INPUT_SLOTS / 2) break;
+                remote[f & (ROLLBACK_INPUT_SLOTS - 1)] = p.inputs[i];
+                confirmed = f;
+                if (f < frame && p.inputs[i].garbage != used[f & (ROLLBACK_INPUT_SLOTS - 1)].garbage) from = std::min(from, f);
+            }
+        }
+        return from;
+    }
+
+    void send() {
+        InputPacket p;
+        p.magic = ROLLBACK_PACKET_MAGIC;
+        p.ack = confirmed;
+        p.first = std::max(remoteAck + 1, frame - ROLLBACK_INPUT_SLOTS);
+        p.count = (uint32_t)(frame - p.first);
+        for (uint32_t i = 0; i < p.count; ++i) p.inputs[i] = local[(p.first + i) & (ROLLBACK_INPUT_SLOTS - 1)];
+        transport->send(&p, offsetof(InputPacket, inputs) + p.count * sizeof(InputFrame));
+    }
+};
+
+RollbackSession versus;
+UdpTransport versusTransport;
+
+// ------------------
+// Stage
+// ------------------
+// Enemy spawns for a whole stage, compiled offline from a text source
+// (--compile-stage, see stage.txt) into a flat little-endian file that the game
+// maps read-only and uses in place: a header, enemy templates, the spawn table
+// sorted by tick, then the pattern names the templates refer to. Loading is
+// a few bounds checks, and the pages are shared by every process running the
+// same stage. Bump STAGE_VERSION whenever a record changes.
+const uint32_t STAGE_MAGIC = 0x47545341; // "ASTG"
+const uint32_t STAGE_VERSION = 1;
+const uint32_t STAGE_NO_PATTERN = 0xffffffffu;
+const uint16_t STAGE_SPAWN_BOSS = 1;
+
+struct StageHeader {
+    uint32_t magic, version;
+    uint32_t fileSize;
+    uint32_t templateSize, spawnSize; // sizeof each record, so a stale file can't be misread
+    uint32_t templateCount, templateOffset;
+    uint32_t spawnCount, spawnOffset;
+    uint32_t namesSize, namesOffset;
+};
+
+struct StageTemplate {
+    float size;
+    int32_t health;
+    int32_t shootCooldown, firstShotDelay; // Aimed shots, when there is no pattern
+    uint32_t pattern; // Offset of the pattern name, or STAGE_NO_PATTERN
+};
+
+struct StageSpawn {
+    int32_t tick;     // After the stage start
+    uint16_t enemy;   // Template index
+    uint16_t flags;   // STAGE_SPAWN_*
+    float x, y;
+    float vx, vy;     // Per tick
+};
+
+// Read-only view of a whole file
+class MappedFile {
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) bytes = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            length = (size_t)fileSize.QuadPart;
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) bytes = (const uint8_t*)p;
+            length = (size_t)info.st_size;
+        }
+        ::close(fd); // The mapping keeps the file
+#endif
+        if (!bytes) close();
+        return bytes != nullptr;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        if (bytes) munmap((void*)bytes, length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+struct Stage {
+    MappedFile file;
+    const StageHeader* header = nullptr;
+    const StageTemplate* templates = nullptr;
+    const StageSpawn* spawns = nullptr;
+    const char* names = nullptr;
+    std::vector<int> patterns; // Per template, resolved once against the loaded patterns
+
+    bool loaded() const { return header != nullptr; }
+    int spawnCount() const { return header ? (int)header->spawnCount : 0; }
+};
+
+Stage stage;
+std::string stagePath = "stage.bin";
+
+// Every spawn has happened and every enemy is gone; without a stage, the boss is down
+bool stageCleared() {
+    if (stageCursor < stage.spawnCount()) return false;
+    for (const Enemy& e : enemies) {
+        if (e.isAlive) return false;
+    }
+    return true;
+}
+
+// A table lies inside the file and is aligned for its records
+bool stageTableFits(const StageHeader& h, uint32_t offset, uint32_t count, uint32_t size) {
+    return offset % 4 == 0 && offset <= h.fileSize && count <= (h.fileSize - offset) / size;
+}
+
+bool loadStage(const std::string& path) {
+    stage.header = nullptr;
+    if (!stage.file.open(path)) return false;
+
+    const StageHeader* h = (const StageHeader*)stage.file.data();
+    bool ok = stage.file.size() >= sizeof(StageHeader)
+        && h->magic == STAGE_MAGIC && h->version == STAGE_VERSION && h->fileSize == stage.file.size()
+        && h->templateSize == sizeof(StageTemplate) && h->spawnSize == sizeof(StageSpawn)
+        && stageTableFits(*h, h->templateOffset, h->templateCount, sizeof(StageTemplate))
+        && stageTableFits(*h, h->spawnOffset, h->spawnCount, sizeof(StageSpawn))
+        && stageTableFits(*h, h->namesOffset, h->namesSize, 1)
+        && (h->namesSize == 0 || stage.file.data()[h->namesOffset + h->namesSize - 1] == 0);
+    if (!ok) {
+        printf("Stage: %s is not a version %u stage file\n", path.c_str(), STAGE_VERSION);
+        stage.file.close();
+        return false;
+    }
+
+    const uint8_t* base = stage.file.data();
+    stage.header = h;
+    stage.templates = (const StageTemplate*)(base + h->templateOffset);
+    stage.spawns = (const StageSpawn*)(base + h->spawnOffset);
+    stage.names = (const char*)(base + h->namesOffset);
+    printf("Stage: mapped %s (%u enemy templates, %u spawns)\n", path.c_str(), h->templateCount, h->spawnCount);
+    return true;
+}
+
+// --compile-stage: text source to the binary format above.
+//   enemy <name> size=S health=N pattern=NAME cooldown=T firstshot=T
+//   spawn <enemy> tick=T x=X y=Y vx=V vy=V [boss] [count=N every=T dx=X dy=Y]
+bool compileStage(const std::string& sourcePath, const std::string& outPath) {
+    std::ifstream source(sourcePath);
+    if (!source) {
+        printf("Stage: can't open %s\n", sourcePath.c_str());
+        return false;
+    }
+
+    std::vector<std::string> templateNames;
+    std::vector<StageTemplate> templates;
+    std::vector<StageSpawn> spawns;
+    std::string names;
+    std::string line;
+    int lineNumber = 0;
+    bool failed = false;
+
+    while (std::getline(source, line)) {
+        lineNumber++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream in(line);
+        std::string word, name, token;
+        if (!(in >> word)) continue;
+
+        bool ok = (bool)(in >> name);
+        if (ok && word == "enemy") {
+            StageTemplate t = { 0.09f, 10, 50, 30, STAGE_NO_PATTERN };
+            while (ok && in >> token) {
+                size_t eq = token.find('=');
+                std::string key = token.substr(0, eq);
+                std::istringstream value(eq == std::string::npos ? "" : token.substr(eq + 1));
+                if (key == "size") ok = (bool)(value >> t.size) && t.size > 0.0f;
+                else if (key == "health") ok = (bool)(value >> t.health) && t.health > 0;
+                else if (key == "cooldown") ok = (bool)(value >> t.shootCooldown) && t.shootCooldown > 0;
+                else if (key == "firstshot") ok = (bool)(value >> t.firstShotDelay) && t.firstShotDelay >= 0;
+                else if (key == "pattern") {
+                    std::string pattern;
+                    ok = (bool)(value >> pattern);
+                    t.pattern = (uint32_t)names.size();
+                    names += pattern;
+                    names += '\0';
+                }
+                else ok = false;
+            }
+            ok = ok && std::find(templateNames.begin(), templateNames.end(), name) == templateNames.end();
+            if (ok) {
+                templateNames.push_back(name);
+                templates.push_back(t);
+            }
+        }
+        else if (ok && word == "spawn") {
+            auto found = std::find(templateNames.begin(), templateNames.end(), name);
+            ok = found != templateNames.end();
+            StageSpawn s = { 0, (uint16_t)(found - templateNames.begin()), 0, 0.0f, 0.0f, 0.0f, 0.0f };
+            int count = 1, every = 0;
+            float dx = 0.0f, dy = 0.0f;
+            while (ok && in >> token) {
+                if (token == "boss") { s.flags |= STAGE_SPAWN_BOSS; continue; }
+                size_t eq = token.find('=');
+                std::string key = token.substr(0, eq);
+                std::istringstream value(eq == std::string::npos ? "" : token.substr(eq + 1));
+                if (key == "tick") ok = (bool)(value >> s.tick) && s.tick >= 0;
+                else if (key == "x") ok = (bool)(value >> s.x);
+                else if (key == "y") ok = (bool)(value >> s.y);
+                else if (key == "vx") ok = (bool)(value >> s.vx);
+                else if (key == "vy") ok = (bool)(value >> s.vy);
+                else if (key == "count") ok = (bool)(value >> count) && count > 0;
+                else if (key == "every") ok = (bool)(value >> every) && every >= 0;
+                else if (key == "dx") ok = (bool)(value >> dx);
+                else if (key == "dy") ok = (bool)(value >> dy);
+                else ok = false;
+            }
+            for (int i = 0; ok && i < count; ++i) {
+                spawns.push_back(s);
+                s.tick += every;
+                s.x += dx;
+                s.y += dy;
+            }
+        }
+        else ok = false;
+
+        if (!ok) {
+            printf("Stage: %s:%d: bad line \"%s\"\n", sourcePath.c_str(), lineNumber, line.c_str());
+            failed = true;
+        }
+    }
+    if (failed) return false;
+
+    // Spawns of the same tick keep their source order
+    std::stable_sort(spawns.begin(), spawns.end(), [](const StageSpawn& a, const StageSpawn& b) { return a.tick < b.tick; });
+
+    StageHeader h = {};
+    h.magic = STAGE_MAGIC;
+    h.version = STAGE_VERSION;
+    h.templateSize = sizeof(StageTemplate);
+    h.spawnSize = sizeof(StageSpawn);
+    h.templateCount = (uint32_t)templates.size();
+    h.templateOffset = sizeof(StageHeader);
+    h.spawnCount = (uint32_t)spawns.size();
+    h.spawnOffset = h.templateOffset + h.templateCount * sizeof(StageTemplate);
+    h.namesSize = (uint32_t)names.size();
+    h.namesOffset = h.spawnOffset + h.spawnCount * sizeof(StageSpawn);
+    h.fileSize = h.namesOffset + h.namesSize;
+
+    std::ofstream out(outPath, std::ios::binary);
+    out.write((const char*)&h, sizeof(h));
+    out.write((const char*)templates.data(), templates.size() * sizeof(StageTemplate));
+    out.write((const char*)spawns.data(), spawns.size() * sizeof(StageSpawn));
+    out.write(names.data(), names.size());
+    if (!out) {
+        printf("Stage: can't write %s\n", outPath.c_str());
+        return false;
+    }
+    printf("Stage: compiled %s to %s (%u enemy templates, %u spawns, %u bytes)\n", sourcePath.c_str(), outPath.c_str(),
+        h.templateCount, h.spawnCount, h.fileSize);
+    return true;
+}
+
+// ------------------
+// Frame capture
+// ------------------
+// Frames are read back into a ring of pixel buffer objects and only mapped
+// once their fence has signaled, so the render thread never waits on the GPU.
+// Mapped pixels are copied into a preallocated pool and encoded by a worker thread.
+const int CAPTURE_PBO_COUNT = 3;
+const int CAPTURE_POOL_SIZE = 8;
+
+struct CaptureSlot {
+    GLuint pbo = 0;
+    GLsync fence = nullptr;
+};
+
+struct FrameCapture {
+    bool active = false;
+    bool y4m = true; // Y4M stream, otherwise PNG sequence
+    std::string path;
+    int width = 0, height = 0;
+    FILE* file = nullptr;
+
+    // Render thread side
+    CaptureSlot slots[CAPTURE_PBO_COUNT];
+    int head = 0;     // Next slot to read back into
+    int inFlight = 0; // Slots waiting on their fence
+
+    // Shared with the worker
+    std::vector<std::vector<unsigned char>> pool;
+    std::deque<int> freeFrames;
+    std::deque<int> readyFrames;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread worker;
+    bool stopping = false;
+
+    // Stats
+    long long issued = 0, written = 0, dropped = 0;
+    double totalMs = 0.0, maxMs = 0.0;
+};
+
+FrameCapture capture;
+
+uint32_t crc32Table[256];
+
+void initCrc32Table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc32Table[i] = c;
+    }
+}
+
+uint32_t crc32Update(uint32_t crc, const unsigned char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) crc = crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+void writeBE32(std::vector<unsigned char>& out, uint32_t v) {
+    out.push_back((v >> 24) & 0xFF); out.push_back((v >> 16) & 0xFF);
+    out.push_back((v >> 8) & 0xFF);  out.push_back(v & 0xFF);
+}
+
+void writePngChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data) {
+    writeBE32(out, (uint32_t)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    uint32_t crc = crc32Update(0xFFFFFFFFu, &out[start], out.size() - start) ^ 0xFFFFFFFFu;
+    writeBE32(out, crc);
+}
+
+// RGB PNG with stored (uncompressed) deflate blocks: no zlib dependency and cheap to encode
+void encodePng(const unsigned char* rgba, int w, int h, std::vector<unsigned char>& out) {
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    out.assign(signature, signature + 8);
+
+    std::vector<unsigned char> ihdr;
+    writeBE32(ihdr, w); writeBE32(ihdr, h);
+    ihdr.push_back(8); ihdr.push_back(2); ihdr.push_back(0); ihdr.push_back(0); ihdr.push_back(0);
+    writePngChunk(out, "IHDR", ihdr);
+
+    // Raw scanlines, top row first (GL rows are bottom-up)
+    std::vector<unsigned char> raw((size_t)(w * 3 + 1) * h);
+    for (int y = 0; y < h; ++y) {
+        unsigned char* dst = &raw[(size_t)(w * 3 + 1) * y];
+        const unsigned char* src = rgba + (size_t)w * 4 * (h - 1 - y);
+        *dst++ = 0;
+        for (int x = 0; x < w; ++x) {
+            *dst++ = src[4 * x]; *dst++ = src[4 * x + 1]; *dst++ = src[4 * x + 2];
+        }
+    }
+
+    std::vector<unsigned char> idat;
+    idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    idat.push_back(0x78); idat.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    for (size_t pos = 0; pos < raw.size();) {
+        size_t len = std::min<size_t>(65535, raw.size() - pos);
+        idat.push_back(pos + len == raw.size() ? 1 : 0);
+        idat.push_back(len & 0xFF); idat.push_back((len >> 8) & 0xFF);
+        idat.push_back(~len & 0xFF); idat.push_back((~len >> 8) & 0xFF);
+        idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + len);
+        for (size_t i = pos; i < pos + len; ++i) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        pos += len;
+    }
+    writeBE32(idat, (b << 16) | a);
+    writePngChunk(out, "IDAT", idat);
+    writePngChunk(out, "IEND", std::vector<unsigned char>());
+}
+
+// BT.601 full range 4:2:0, matching the C420jpeg tag in the stream header
+void encodeY4mFrame(const unsigned char* rgba, int w, int h, std::vector<unsigned char>& out) {
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    out.resize((size_t)w * h + 2 * (size_t)cw * ch);
+    unsigned char* yPlane = out.data();
+    unsigned char* uPlane = yPlane + (size_t)w * h;
+    unsigned char* vPlane = uPlane + (size_t)cw * ch;
+
+    for (int y = 0; y < h; ++y) {
+        const unsigned char* src = rgba + (size_t)w * 4 * (h - 1 - y);
+        for (int x = 0; x < w; ++x) {
+            int r = src[4 * x], g = src[4 * x + 1], b = src[4 * x + 2];
+            yPlane[(size_t)y * w + x] = (unsigned char)((77 * r + 150 * g + 29 * b + 128) >> 8);
+        }
+    }
+    for (int cy = 0; cy < ch; ++cy) {
+        for (int cx = 0; cx < cw; ++cx) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int dy = 0; dy < 2; ++dy) {
+                int y = std::min(cy * 2 + dy, h - 1);
+                const unsigned char* src = rgba + (size_t)w * 4 * (h - 1 - y);
+                for (int dx = 0; dx < 2; ++dx) {
+                    int x = std::min(cx * 2 + dx, w - 1);
+                    r += src[4 * x]; g += src[4 * x + 1]; b += src[4 * x + 2]; ++n;
+                }
+            }
+            r /= n; g /= n; b /= n;
+            int u = ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+            int v = ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+            uPlane[(size_t)cy * cw + cx] = (unsigned char)std::min(255, std::max(0, u));
+            vPlane[(size_t)cy * cw + cx] = (unsigned char)std::min(255, std::max(0, v));
+        }
+    }
+}
+
+void captureWorker() {
+    traceThreadName("capture");
+    std::vector<unsigned char> encoded;
+    char name[512];
+
+    while (true) {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(capture.mutex);
+            capture.cv.wait(lock, [] { return !capture.readyFrames.empty() || capture.stopping; });
+            if (capture.readyFrames.empty()) break;
+            index = capture.readyFrames.front();
+            capture.readyFrames.pop_front();
+        }
+
+        TRACE_SCOPE(capture.y4m ? "encodeY4m" : "encodePng");
+        const unsigned char* pixels = capture.pool[index].data();
+        if (capture.y4m) {
+            encodeY4mFrame(pixels, capture.width, capture.height, encoded);
+            fputs("FRAME\n", capture.file);
+            fwrite(encoded.data(), 1, encoded.size(), capture.file);
+        }
+        else {
+            encodePng(pixels, capture.width, capture.height, encoded);
+            snprintf(name, sizeof(name), "%s_%06lld.png", capture.path.c_str(), capture.written);
+            FILE* f = fopen(name, "wb");
+            if (f) {
+                fwrite(encoded.data(), 1, encoded.size(), f);
+                fclose(f);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        capture.written++;
+        capture.freeFrames.push_back(index);
+    }
+}
+
+// Copy a finished readback into a pool frame and hand it to the worker
+void retireCaptureSlot(CaptureSlot& slot) {
+    int index = -1;
+    {
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        if (!capture.freeFrames.empty()) {
+            index = capture.freeFrames.front();
+            capture.freeFrames.pop_front();
+        }
+    }
+
+    if (index < 0) capture.dropped++; // Encoder fell behind
+    else {
+        size_t size = (size_t)capture.width * capture.height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        void* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (src) {
+            memcpy(capture.pool[index].data(), src, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        if (src) capture.readyFrames.push_back(index);
+        else capture.freeFrames.push_back(index);
+        capture.cv.notify_one();
+    }
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+}
+
+bool startCapture(const std::string& path) {
+    if (capture.active) return false;
+    if (!GLEW_ARB_pixel_buffer_object || !GLEW_ARB_sync) {
+        printf("Capture: PBO/sync extensions not supported\n");
+        return false;
+    }
+
+    capture.path = path;
+    capture.y4m = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+    capture.width = glutGet(GLUT_WINDOW_WIDTH);
+    capture.height = glutGet(GLUT_WINDOW_HEIGHT);
+    capture.file = nullptr;
+    if (capture.y4m) {
+        capture.file = fopen(path.c_str(), "wb");
+        if (!capture.file) {
+            printf("Capture: cannot open %s\n", path.c_str());
+            return false;
+        }
+        fprintf(capture.file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", capture.width, capture.height);
+    }
+
+    size_t size = (size_t)capture.width * capture.height * 4;
+    for (auto& slot : capture.slots) {
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.fence = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    capture.pool.assign(CAPTURE_POOL_SIZE, std::vector<unsigned char>(size));
+    capture.freeFrames.clear();
+    capture.readyFrames.clear();
+    for (int i = 0; i < CAPTURE_POOL_SIZE; ++i) capture.freeFrames.push_back(i);
+
+    capture.head = 0;
+    capture.inFlight = 0;
+    capture.issued = capture.written = capture.dropped = 0;
+    capture.totalMs = capture.maxMs = 0.0;
+    capture.stopping = false;
+    capture.worker = std::thread(captureWorker);
+    capture.active = true;
+    printf("Capture: recording %dx%d to %s\n", capture.width, capture.height, path.c_str());
+    return true;
+}
+
+// With the GL context still current, in-flight readbacks are drained before shutting down
+void stopCapture(bool hasContext = true) {
+    if (!capture.active) return;
+
+    while (hasContext && capture.inFlight > 0) {
+        CaptureSlot& slot = capture.slots[(capture.head - capture.inFlight + CAPTURE_PBO_COUNT) % CAPTURE_PBO_COUNT];
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        retireCaptureSlot(slot);
+        capture.inFlight--;
+    }
+    for (auto& slot : capture.slots) {
+        if (hasContext) glDeleteBuffers(1, &slot.pbo);
+        slot.pbo = 0;
+    }
+    capture.inFlight = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        capture.stopping = true;
+    }
+    capture.cv.notify_one();
+    capture.worker.join();
+    if (capture.file) fclose(capture.file);
+    capture.file = nullptr;
+    capture.active = false;
+
+    printf("Capture: %lld frames written, %lld dropped, render thread avg %.3f ms, max %.3f ms\n",
+        capture.written, capture.dropped,
+        capture.issued > 0 ? capture.totalMs / capture.issued : 0.0, capture.maxMs);
+}
+
+// Called after the scene is drawn, before swapping buffers
+void captureFrame() {
+    TRACE_SCOPE("captureFrame");
+    if (!capture.active) return;
+    auto t0 = std::chrono::steady_clock::now();
+
+    if (glutGet(GLUT_WINDOW_WIDTH) != capture.width || glutGet(GLUT_WINDOW_HEIGHT) != capture.height) {
+        printf("Capture: window resized, stopping\n");
+        stopCapture();
+        return;
+    }
+
+    // Retire every readback whose fence already signaled, oldest first
+    while (capture.inFlight > 0) {
+        CaptureSlot& slot = capture.slots[(capture.head - capture.inFlight + CAPTURE_PBO_COUNT) % CAPTURE_PBO_COUNT];
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        retireCaptureSlot(slot);
+        capture.inFlight--;
+    }
+
+    // Ring full means the GPU is still busy with older readbacks: drop instead of stalling
+    if (capture.inFlight == CAPTURE_PBO_COUNT) capture.dropped++;
+    else {
+        CaptureSlot& slot = capture.slots[capture.head];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        capture.head = (capture.head + 1) % CAPTURE_PBO_COUNT;
+        capture.inFlight++;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    capture.issued++;
+    capture.totalMs += ms;
+    capture.maxMs = std::max(capture.maxMs, ms);
+}
+
+void display() {
+    TRACE_SCOPE("display");
+    adjustRenderScale();
+    gpuPassBegin(GPU_PASS_SCENE);
+    bloomBegin();
+    glClear(GL_COLOR_BUFFER_BIT);
+    drawBackground();
+
+    updateCamera();
+    drawPlayer();
+    drawEnemies();
+    drawTrails();
+    drawBullets();
+    drawBeams();
+    drawParticles();
+    glLoadIdentity(); // HUD is not shaken
+    gpuPassEnd();
+    bloomEnd();
+
+    Enemy* boss = enemies.get(bossHandle);
+    std::stringstream ss;
+    ss << "Lives: " << playerLives << "   Enemy HP: " << (boss && boss->isAlive ? boss->health : 0) << "   Graze: " << grazeCount;
+    drawText(-0.98f, 0.95f, ss.str());
+
+    if (versus.active()) {
+        std::stringstream vs;
+        vs << "Versus  garbage " << std::max(garbageCharge, 0) * 100 / GARBAGE_COST << "%   rollback " << versus.lastRollback
+            << " (max " << versus.maxRollback << ")   stalls " << versus.stalls;
+        drawText(-0.98f, 0.90f, vs.str());
+    }
+
+    if (isGameOver) {
+        drawText(-0.1f, 0.0f, "GAME OVER");
+    }
+    else if (stageCleared()) {
+        drawText(-0.12f, 0.0f, "ENEMY DESTROYED!");
+    }
+
+    captureFrame();
+    gpuProfilerFrame();
+    {
+        TRACE_SCOPE("swapBuffers");
+        glutSwapBuffers();
+        framePresented();
+    }
+}
+
+Handle spawnEnemyBullet(const Enemy& enemy) {
+    if (!enemy.isAlive) return INVALID_HANDLE;
+
+    // Calculate direction vector towards player
+    float dx = playerX - enemy.x;
+    float dy = playerY - enemy.y;
+    float len = std::sqrt(dx * dx + dy * dy);
+
+    Bullet b;
+    b.x = enemy.x;
+    b.y = enemy.y - (enemy.size + 0.02f);
+    b.speed = tuning.enemyBulletSpeed;
+    if (len == 0) { b.vx = 0; b.vy = -1; }
+    else { b.vx = dx / len; b.vy = dy / len; }
+    return enemyBullets.insert(b);
+}
+
+// Versus: volleys the opponent sent, fanned from the top edge at the ship.
+// Positions come from the tick alone, so every replay of the tick agrees.
+void spawnGarbage(int volleys) {
+    for (int v = 0; v < volleys; ++v) {
+        uint32_t h = (uint32_t)(simTick * 8 + v) * 2654435761u;
+        float x = (h >> 16) / 65535.0f * 1.6f - 0.8f;
+        float y = 0.95f;
+        float aim = std::atan2(playerY - y, playerX - x);
+
+        size_t first = enemyBullets.insertBatch(GARBAGE_VOLLEY_SIZE);
+        int count = (int)(enemyBullets.size() - first);
+        for (int i = 0; i < count; ++i) {
+            size_t j = first + i;
+            float angle = aim + (i - (count - 1) * 0.5f) * 0.2f;
+            enemyBullets.x0[j] = x;
+            enemyBullets.y0[j] = y;
+            enemyBullets.vx[j] = std::cos(angle) * tuning.enemyBulletSpeed * 0.5f;
+            enemyBullets.vy[j] = std::sin(angle) * tuning.enemyBulletSpeed * 0.5f;
+            enemyBullets.kind[j] = TRAJ_LINEAR;
+            enemyBullets.params[j] = TrajectoryParams();
+        }
+        enemyBullets.finishBatch(first, count);
+    }
+}
+
+// ------------------
+// Bullet patterns
+// ------------------
+// Patterns are declared in patterns.txt as nested emitters and compiled at load
+// time into one shared bytecode array. Each top-level emitter runs as its own VM
+// thread; a nested emitter runs to completion on every volley of its parent, with
+// angles relative to the parent's current angle. A pattern restarts once all of
+// its threads finish.
+//
+//   path swoop 0,0 0.3,-0.4 -0.3,-0.8 0,-2.4
+//   pattern boss {
+//       emitter count=24 spread=360 spin=7.5 speed=0.025 volleys=40 interval=5 {
+//           emitter count=3 spread=20 speed=0.03 wave=0.05
+//       }
+//       emitter aim path=swoop pathticks=30
+//   }
+//
+// Angles are in degrees, 0 pointing down, counter-clockwise positive. Paths are
+// declared for a bullet fired downwards and rotated to the firing angle.
+enum PatternOp : uint32_t {
+    OP_END,       //                    Thread finished
+    OP_WAIT,      // ticks              Yield for a number of ticks
+    OP_PUSH,      //                    Save registers
+    OP_POP,       //                    Restore registers
+    OP_TURN,      // radians            angle += operand
+    OP_AIM,       // radians            angle = direction to player + operand
+    OP_SPEED,     // speed              speed = operand
+    OP_ADD_SPEED, // speed              speed += operand
+    OP_LOOP,      // count              Start a loop body
+    OP_NEXT,      //                    Jump back to the loop body while iterations remain
+    OP_FIRE,      // count, step, start Emit count bullets in one batch
+    OP_TRAJ,      // kind, a, b, path   Trajectory of the following volleys
+    OP_BEAM,      // count, step, start, ticks, radius, sweep
+                  //                    Fire count lasers, each lasting ticks after the warmup
+    OP_JITTER,    // radians            Random spread of each following bullet (patternRng)
+};
+
+struct Pattern {
+    std::string name;
+    std::vector<uint32_t> entries; // Thread entry points into patternCode
+};
+
+std::vector<uint32_t> patternCode;
+std::vector<Pattern> patterns;
+std::string patternPath = "patterns.txt";
+
+inline uint32_t floatBits(float f) { uint32_t u; memcpy(&u, &f, 4); return u; }
+inline float bitsFloat(uint32_t u) { float f; memcpy(&f, &u, 4); return f; }
+
+struct EmitterDecl {
+    int count = -1; // -1: 1 for a leaf emitter, 0 when it has children
+    float spread = 0.0f, angle = 0.0f, spin = 0.0f;
+    float speed = -1.0f, speedStep = 0.0f; // speed -1: inherit
+    int volleys = 1, interval = 0, delay = 0;
+    bool aim = false;
+    int traj = -1; // -1: inherit
+    float trajA = 0.0f, trajB = 0.0f;
+    int path = -1;
+    int laser = 0; // Ticks each laser lasts; 0 fires bullets
+    float laserWidth = 0.03f, laserSweep = 0.0f;
+    float jitter = -1.0f; // Degrees; -1: inherit
+    std::vector<EmitterDecl> children;
+};
+
+void compileEmitter(const EmitterDecl& e, std::vector<uint32_t>& code) {
+    const float DEG = PI / 180.0f;
+    if (e.delay > 0) { code.push_back(OP_WAIT); code.push_back(e.delay); }
+    code.push_back(OP_PUSH);
+    if (e.aim) { code.push_back(OP_AIM); code.push_back(floatBits(e.angle * DEG)); }
+    else if (e.angle != 0.0f) { code.push_back(OP_TURN); code.push_back(floatBits(e.angle * DEG)); }
+    if (e.speed >= 0.0f) { code.push_back(OP_SPEED); code.push_back(floatBits(e.speed)); }
+    if (e.jitter >= 0.0f) { code.push_back(OP_JITTER); code.push_back(floatBits(e.jitter * DEG)); }
+    if (e.traj >= 0) {
+        code.push_back(OP_TRAJ); code.push_back(e.traj);
+        code.push_back(floatBits(e.trajA)); code.push_back(floatBits(e.trajB)); code.push_back(e.path);
+    }
+
+    code.push_back(OP_LOOP); code.push_back(std::max(1, e.volleys));
+    for (const auto& child : e.children) compileEmitter(child, code);
+
+    int count = e.count >= 0 ? e.count : (e.children.empty() ? 1 : 0);
+    if (count > 0) {
+        // Full circle: evenly spaced ring. Otherwise a fan centered on the current angle
+        float spread = e.spread * DEG;
+        float step, start;
+        if (e.spread >= 360.0f) { step = 2 * PI / count; start = 0.0f; }
+        else if (count > 1) { step = spread / (count - 1); start = -spread / 2; }
+        else { step = 0.0f; start = 0.0f; }
+        code.push_back(e.laser > 0 ? OP_BEAM : OP_FIRE); code.push_back(count);
+        code.push_back(floatBits(step)); code.push_back(floatBits(start));
+        if (e.laser > 0) {
+            code.push_back(e.laser);
+            code.push_back(floatBits(e.laserWidth)); code.push_back(floatBits(e.laserSweep * DEG));
+        }
+    }
+    if (e.spin != 0.0f) { code.push_back(OP_TURN); code.push_back(floatBits(e.spin * DEG)); }
+    if (e.speedStep != 0.0f) { code.push_back(OP_ADD_SPEED); code.push_back(floatBits(e.speedStep)); }
+    if (e.interval > 0) { code.push_back(OP_WAIT); code.push_back(e.interval); }
+    code.push_back(OP_NEXT);
+    code.push_back(OP_POP);
+}
+
+// Parses the key=value attributes of an "emitter" line
+bool parseEmitterLine(std::istringstream& in, EmitterDecl& e) {
+    std::string token;
+    while (in >> token) {
+        if (token == "{") continue;
+        if (token == "aim") { e.aim = true; continue; }
+        size_t eq = token.find('=');
+        if (eq == std::string::npos) return false;
+        std::string key = token.substr(0, eq);
+        std::istringstream value(token.substr(eq + 1));
+        bool ok;
+        if (key == "count") ok = (bool)(value >> e.count) && e.count >= 0;
+        else if (key == "spread") ok = (bool)(value >> e.spread);
+        else if (key == "angle") ok = (bool)(value >> e.angle);
+        else if (key == "spin") ok = (bool)(value >> e.spin);
+        else if (key == "speed") ok = (bool)(value >> e.speed);
+        else if (key == "speedstep") ok = (bool)(value >> e.speedStep);
+        else if (key == "volleys") ok = (bool)(value >> e.volleys) && e.volleys > 0;
+        else if (key == "interval") ok = (bool)(value >> e.interval) && e.interval >= 0;
+        else if (key == "delay") ok = (bool)(value >> e.delay) && e.delay >= 0;
+        else if (key == "wave") {
+            ok = (bool)(value >> e.trajA);
+            e.traj = TRAJ_SINE;
+            if (e.trajB == 0.0f) e.trajB = 12.0f * PI / 180.0f;
+        }
+        else if (key == "wavefreq") {
+            ok = (bool)(value >> e.trajB);
+            e.trajB *= PI / 180.0f;
+        }
+        else if (key == "orbit") {
+            ok = (bool)(value >> e.trajA);
+            e.trajA *= PI / 180.0f;
+            e.traj = TRAJ_CIRCULAR;
+        }
+        else if (key == "path") {
+            std::string name;
+            ok = (bool)(value >> name);
+            e.path = -1;
+            for (size_t i = 0; i < trajectoryPaths.size(); ++i) {
+                if (trajectoryPaths[i].name == name) e.path = (int)i;
+            }
+            ok = ok && e.path >= 0;
+            e.traj = TRAJ_SPLINE;
+            if (e.trajA == 0.0f) e.trajA = 20.0f;
+        }
+        else if (key == "pathticks") ok = (bool)(value >> e.trajA) && e.trajA > 0.0f;
+        else if (key == "homing") {
+            ok = (bool)(value >> e.trajA) && e.trajA > 0.0f;
+            e.trajA *= PI / 180.0f;
+            e.traj = TRAJ_HOMING;
+            if (e.trajB == 0.0f) e.trajB = 90.0f;
+        }
+        else if (key == "homingticks") ok = (bool)(value >> e.trajB) && e.trajB > 0.0f;
+        else if (key == "linear") { e.traj = TRAJ_LINEAR; ok = true; }
+        else if (key == "laser") ok = (bool)(value >> e.laser) && e.laser > 0;
+        else if (key == "width") ok = (bool)(value >> e.laserWidth) && e.laserWidth > 0.0f;
+        else if (key == "sweep") ok = (bool)(value >> e.laserSweep);
+        else if (key == "jitter") ok = (bool)(value >> e.jitter) && e.jitter >= 0.0f;
+        else ok = false;
+        if (!ok) return false;
+    }
+    return true;
 }
 
-void drawBullets() {
-    for (auto& b : bullets) {
+int findPattern(const std::string& name) {
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        if (patterns[i].name == name) return (int)i;
+    }
+    return -1;
+}
 
-        // Player bullet : two yellow rectangles
-        if (b.isFromPlayer)
-        {
-            glColor3f(1.0f, 1.0f, 0.0f);
-            glPushMatrix();
-            glTranslatef(b.x - 0.75f * BULLET_SIZE, b.y, 0.0f);
-            drawSquare(BULLET_SIZE);
-            glPopMatrix();
+void loadPatterns() {
+    std::ifstream file(patternPath);
+    if (!file) return;
+
+    std::string line, name;
+    std::vector<EmitterDecl> roots;
+    std::vector<EmitterDecl*> open; // Emitters whose '{' is not closed yet
+    bool inPattern = false, failed = false;
+    int lineNumber = 0;
 
-            glPushMatrix();
-            glTranslatef(b.x + 0.75f * BULLET_SIZE, b.y, 0.0f);
-            drawSquare(BULLET_SIZE);
-            glPopMatrix();
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream in(line);
+        std::string word;
+        if (!(in >> word)) continue;
+
+        bool ok = true;
+        if (word == "path" && !inPattern) {
+            // path <name> x,y x,y ...
+            TrajectoryPath path;
+            ok = (bool)(in >> path.name);
+            std::string point;
+            while (ok && in >> point) {
+                glm::vec2 v;
+                ok = sscanf(point.c_str(), "%f,%f", &v.x, &v.y) == 2;
+                path.points.push_back(v);
+            }
+            ok = ok && path.points.size() >= 2;
+            if (ok) trajectoryPaths.push_back(path);
         }
+        else if (word == "pattern" && !inPattern) {
+            ok = (bool)(in >> name);
+            inPattern = true;
+            failed = false;
+            roots.clear();
+            open.clear();
+        }
+        else if (word == "emitter" && inPattern) {
+            EmitterDecl e;
+            ok = parseEmitterLine(in, e);
+            std::vector<EmitterDecl>& parent = open.empty() ? roots : open.back()->children;
+            if (!open.empty() || (int)roots.size() < PATTERN_MAX_THREADS) parent.push_back(e);
+            else ok = false;
+            if (ok && line.find('{') != std::string::npos) open.push_back(&parent.back());
+        }
+        else if (word == "}" && inPattern) {
+            if (!open.empty()) open.pop_back();
+            else {
+                // Pattern closed: compile each root emitter as a thread
+                if (!failed && !roots.empty()) {
+                    Pattern p;
+                    p.name = name;
+                    for (const auto& root : roots) {
+                        p.entries.push_back((uint32_t)patternCode.size());
+                        compileEmitter(root, patternCode);
+                        patternCode.push_back(OP_END);
+                    }
+                    patterns.push_back(p);
+                }
+                inPattern = false;
+            }
+        }
+        else ok = false;
 
-		// Enemy bullet : red circle
-        else
-        {
-            glPushMatrix();
-            glTranslatef(b.x, b.y, 0.0f);            
-            glColor3f(1.0f, 0.0f, 0.0f);
-            drawCircle(BULLET_SIZE);
-            glPopMatrix();
-        }        
+        if (!ok) {
+            printf("Patterns: %s:%d: bad line \"%s\"\n", patternPath.c_str(), lineNumber, line.c_str());
+            failed = true;
+        }
     }
-}
-// ------------------
 
-// Fuction for collision detection
-bool rectCollision(float x1, float y1, float s1, float x2, float y2, float s2) {
-    return std::abs(x1 - x2) < (s1 + s2) / 2 && std::abs(y1 - y2) < (s1 + s2) / 2;
+    printf("Patterns: loaded %d patterns (%d bytecode words)\n", (int)patterns.size(), (int)patternCode.size());
 }
 
-void drawText(float x, float y, const std::string& text) {
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glRasterPos2f(x, y);
-    for (char c : text) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
+void startPattern(PatternState& state, int pattern) {
+    state.pattern = pattern;
+    state.threadCount = 0;
+    if (pattern < 0) return;
+    for (uint32_t entry : patterns[pattern].entries) {
+        PatternThread& t = state.threads[state.threadCount++];
+        t.pc = entry;
+        t.wait = 0;
+        t.regs.angle = -PI / 2; // Down
+        t.regs.speed = tuning.enemyBulletSpeed;
+        t.regs.traj = TRAJ_LINEAR;
+        t.regs.trajA = t.regs.trajB = 0.0f;
+        t.regs.path = -1;
+        t.regs.jitter = 0.0f;
+        t.loopDepth = t.saveDepth = 0;
+        t.done = false;
     }
 }
 
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT);
+// Appends a whole volley to the enemy bullet pool with one resize; directions come
+// from rotating a unit vector, so a ring costs one sin/cos pair regardless of size.
+// Jittered volleys take their offsets from one batch fill and turn each bullet
+// separately.
+std::vector<float> volleyJitter;
 
-    // Camera shake effect
-    glPushMatrix();
-    if (shakeTimer > 0) {
-        float offsetX = ((rand() % 100) / 100.0f - 0.5f) * 2 * shakeManitude;
-        float offsetY = ((rand() % 100) / 100.0f - 0.5f) * 2 * shakeManitude;
-        glTranslatef(offsetX, offsetY, 0.0f);
-        shakeTimer--;
+void emitVolley(const Enemy& enemy, int count, float angle, float step, const PatternRegs& regs) {
+    BulletPool& pool = enemyBullets;
+    size_t first = pool.insertBatch(count);
+    count = (int)(pool.size() - first);
+    float cx = std::cos(angle), cy = std::sin(angle);
+    float cs = std::cos(step), sn = std::sin(step);
+    float turnCos = std::cos(regs.trajA), turnSin = std::sin(regs.trajA);
+    if (regs.jitter > 0.0f) {
+        volleyJitter.resize(count);
+        patternRng.fillUniform(volleyJitter.data(), count, -regs.jitter / 2, regs.jitter / 2);
     }
+    for (int i = 0; i < count; ++i) {
+        size_t j = first + i;
+        float dx = cx, dy = cy;
+        if (regs.jitter > 0.0f) {
+            float jc = std::cos(volleyJitter[i]), js = std::sin(volleyJitter[i]);
+            dx = cx * jc - cy * js;
+            dy = cx * js + cy * jc;
+        }
+        pool.x0[j] = enemy.x;
+        pool.y0[j] = enemy.y;
+        pool.vx[j] = dx * regs.speed;
+        pool.vy[j] = dy * regs.speed;
+        pool.kind[j] = (uint8_t)regs.traj;
 
-    drawPlayer();
-    drawEnemy();
-    drawBullets();
-    glPopMatrix();
+        TrajectoryParams& p = pool.params[j];
+        p = TrajectoryParams();
+        switch (regs.traj) {
+        case TRAJ_SINE: p.a = regs.trajA; p.b = regs.trajB; break;
+        case TRAJ_CIRCULAR: p.a = regs.speed; p.b = std::atan2(dy, dx); p.c = regs.trajA; break;
+        case TRAJ_SPLINE: p.a = -dy; p.b = dx; p.c = regs.trajA; p.path = regs.path; break;
+        case TRAJ_HOMING: p.a = turnCos; p.b = turnSin; p.c = regs.trajB; break;
+        }
 
-    std::stringstream ss;
-    ss << "Lives: " << playerLives << "   Enemy HP: " << (enemy.isAlive ? enemy.health : 0);
-    drawText(-0.98f, 0.95f, ss.str());
+        float nx = cx * cs - cy * sn;
+        cy = cx * sn + cy * cs;
+        cx = nx;
+    }
+    pool.finishBatch(first, count);
+}
 
-    if (isGameOver) {
-        drawText(-0.1f, 0.0f, "GAME OVER");
+// Lasers fanned like a volley; they follow the enemy and end with it
+void emitBeams(const Enemy& enemy, int count, float angle, float step, int ticks, float radius, float sweep) {
+    Handle owner = enemies.handleAt(&enemy - &enemies[0]);
+    for (int i = 0; i < count; ++i) {
+        fireBeam(enemy.x, enemy.y, angle + step * i, sweep, radius, tuning.enemyLaserWarmup, ticks, BEAM_HITS_PLAYER, owner);
     }
-    else if (!enemy.isAlive) {
-        drawText(-0.12f, 0.0f, "ENEMY DESTROYED!");
+}
+
+void runPattern(Enemy& enemy) {
+    PatternState& state = enemy.pattern;
+    const uint32_t* code = patternCode.data();
+    bool allDone = true;
+
+    for (int i = 0; i < state.threadCount; ++i) {
+        PatternThread& t = state.threads[i];
+        if (t.done) continue;
+        if (t.wait > 0 && --t.wait > 0) { allDone = false; continue; }
+
+        // Run until the thread yields; the budget guards against wait-free loops
+        for (int budget = 4096; budget > 0 && t.wait == 0 && !t.done; --budget) {
+            switch (code[t.pc]) {
+            case OP_END: t.done = true; break;
+            case OP_WAIT: t.wait = (int)code[t.pc + 1]; t.pc += 2; break;
+            case OP_PUSH:
+                if (t.saveDepth < PATTERN_MAX_DEPTH) t.saved[t.saveDepth] = t.regs;
+                t.saveDepth++;
+                t.pc += 1;
+                break;
+            case OP_POP:
+                t.saveDepth--;
+                if (t.saveDepth < PATTERN_MAX_DEPTH) t.regs = t.saved[t.saveDepth];
+                t.pc += 1;
+                break;
+            case OP_TURN: t.regs.angle += bitsFloat(code[t.pc + 1]); t.pc += 2; break;
+            case OP_AIM:
+                t.regs.angle = std::atan2(playerY - enemy.y, playerX - enemy.x) + bitsFloat(code[t.pc + 1]);
+                t.pc += 2;
+                break;
+            case OP_SPEED: t.regs.speed = bitsFloat(code[t.pc + 1]); t.pc += 2; break;
+            case OP_JITTER: t.regs.jitter = bitsFloat(code[t.pc + 1]); t.pc += 2; break;
+            case OP_ADD_SPEED: t.regs.speed += bitsFloat(code[t.pc + 1]); t.pc += 2; break;
+            case OP_TRAJ:
+                t.regs.traj = (int)code[t.pc + 1];
+                t.regs.trajA = bitsFloat(code[t.pc + 2]);
+                t.regs.trajB = bitsFloat(code[t.pc + 3]);
+                t.regs.path = (int)code[t.pc + 4];
+                t.pc += 5;
+                break;
+            case OP_LOOP:
+                if (t.loopDepth >= PATTERN_MAX_DEPTH) { t.done = true; break; } // Nested too deep
+                t.loopRemaining[t.loopDepth] = (int)code[t.pc + 1];
+                t.loopStart[t.loopDepth] = t.pc + 2;
+                t.loopDepth++;
+                t.pc += 2;
+                break;
+            case OP_NEXT:
+                if (--t.loopRemaining[t.loopDepth - 1] > 0) t.pc = t.loopStart[t.loopDepth - 1];
+                else { t.loopDepth--; t.pc += 1; }
+                break;
+            case OP_FIRE:
+                emitVolley(enemy, (int)code[t.pc + 1], t.regs.angle + bitsFloat(code[t.pc + 3]), bitsFloat(code[t.pc + 2]), t.regs);
+                t.pc += 4;
+                break;
+            case OP_BEAM:
+                emitBeams(enemy, (int)code[t.pc + 1], t.regs.angle + bitsFloat(code[t.pc + 3]), bitsFloat(code[t.pc + 2]),
+                    (int)code[t.pc + 4], bitsFloat(code[t.pc + 5]), bitsFloat(code[t.pc + 6]));
+                t.pc += 7;
+                break;
+            default: t.done = true; break;
+            }
+        }
+        if (!t.done) allDone = false;
     }
 
-    glutSwapBuffers();
+    if (allDone) startPattern(state, state.pattern);
 }
 
-void spawnEnemyBullet() {
-    if (!enemy.isAlive) return;
+// Patterns are referenced by name in the stage file; look each up once
+void bindStagePatterns() {
+    if (!stage.loaded()) return;
+    stage.patterns.assign(stage.header->templateCount, -1);
+    for (uint32_t i = 0; i < stage.header->templateCount; ++i) {
+        uint32_t name = stage.templates[i].pattern;
+        if (name == STAGE_NO_PATTERN || name >= stage.header->namesSize) continue;
+        stage.patterns[i] = findPattern(stage.names + name);
+        if (stage.patterns[i] < 0) printf("Stage: no pattern \"%s\", enemy %u uses aimed shots\n", stage.names + name, i);
+    }
+}
 
-    // Calculate direction vector towards player
-    float dx = playerX - enemy.x;
-    float dy = playerY - enemy.y;
-    float len = std::sqrt(dx * dx + dy * dy);
+// Spawns due this tick, read straight from the mapped table
+void updateStage() {
+    TICK_PHASE(PHASE_STAGE);
+    if (!stage.loaded()) return;
+    const int tick = simTick - stageStartTick;
+    const int count = stage.spawnCount();
+    for (; stageCursor < count && stage.spawns[stageCursor].tick <= tick; ++stageCursor) {
+        const StageSpawn& s = stage.spawns[stageCursor];
+        if (s.enemy >= stage.header->templateCount) continue;
+        const StageTemplate& t = stage.templates[s.enemy];
 
-    Bullet b;
-    b.x = enemy.x;
-    b.y = enemy.y - (enemy.size + 0.02f);
-    b.isFromPlayer = false;
-    b.speed = 0.04f;
-    if (len == 0) { b.vx = 0; b.vy = -1; }
-    else { b.vx = dx / len; b.vy = dy / len; }
-    bullets.push_back(b);
+        Enemy enemy = Enemy(); // Zeroed padding, see "State hash"
+        enemy.x = s.x;
+        enemy.y = s.y;
+        enemy.vx = s.vx;
+        enemy.vy = s.vy;
+        enemy.size = t.size;
+        enemy.health = t.health;
+        enemy.maxHealth = t.health;
+        enemy.shootCooldown = t.firstShotDelay;
+        enemy.shootInterval = t.shootCooldown;
+        enemy.isAlive = true;
+        startPattern(enemy.pattern, stage.patterns[s.enemy]);
+        Handle h = enemies.insert(enemy);
+        if (s.flags & STAGE_SPAWN_BOSS) bossHandle = h;
+    }
 }
 
 void updateBullets() {
-    // Update bullet positions
-    for (auto& b : bullets) {
-        b.x += b.vx * b.speed;
-        b.y += b.vy * b.speed;
+    TICK_PHASE(PHASE_BULLETS);
+    // Positions are closed-form, so only homing bullets and bullets that left the window need work
+    simTick++;
+    enemyBullets.steer(simTick, playerX, playerY);
+    playerBullets.removeExpired(simTick);
+    enemyBullets.removeExpired(simTick);
+}
+
+// Shared by bullet and laser hits. Bullets still in the hit mask after the killing
+// hit are removed by the caller but do nothing more
+void damageEnemy(Enemy& enemy) {
+    if (!enemy.isAlive) return;
+    enemy.health -= 1;
+    garbageCharge += GARBAGE_CHARGE_PER_HIT;
+    if (enemy.health <= 0) {
+        enemy.isAlive = false;
+        particles.enqueue(enemy.x, enemy.y, ENEMY_DEATH_STYLE);
+    }
+    else
+    {
+        addTrauma(TRAUMA_HIT);
     }
+}
 
-    // Erase bullets out of window
-    bullets.erase(
-        std::remove_if(bullets.begin(), bullets.end(), [](const Bullet& b) {
-            return b.x < -1.1f || b.x > 1.1f || b.y < -1.1f || b.y > 1.1f;
-            }),
-        bullets.end()
-    );
+void killPlayer() {
+    playerLives--;
+    isPlayerAlive = false;
+    respawnTimer = tuning.respawnFrames;
+    beams.remove(playerBeam);
+    particles.enqueue(playerX, playerY, PLAYER_DEATH_STYLE);
+    if (playerLives <= 0) {
+        isGameOver = true;
+    }
+    else
+    {
+        addTrauma(TRAUMA_HIT);
+    }
 }
 
 void handleCollisions() {
-    // Player bullet collision with enemy
-    if (enemy.isAlive) {
-        for (auto it = bullets.begin(); it != bullets.end();) {
-            if (it->isFromPlayer) {
-                if (rectCollision(it->x, it->y, BULLET_SIZE, enemy.x, enemy.y, enemy.size)) {
-                    enemy.health -= 1;
-                    it = bullets.erase(it);
-                    if (enemy.health <= 0) {
-                        enemy.isAlive = false;
-                    }
-                    else
-                    {
-                        shakeTimer = 15; // Shake for 5 frames
-                    }
-                }
-                else ++it;
+    TICK_PHASE(PHASE_COLLISIONS);
+    // Player bullet collision with enemies
+    bool anyEnemyAlive = false;
+    for (auto& enemy : enemies) anyEnemyAlive |= enemy.isAlive;
+    if (anyEnemyAlive) playerBullets.ensurePositions(simTick);
+
+    for (auto& enemy : enemies) {
+        if (!enemy.isAlive) continue;
+        if (bulletHitMask(playerBullets, enemy.x, enemy.y, enemy.size) == 0) continue;
+
+        // Highest index first: swap-remove only moves bullets that were already tested
+        for (size_t w = hitMask.size(); w-- > 0;) {
+            uint32_t bits = hitMask[w];
+            while (bits) {
+                int bit = highestBit(bits);
+                bits &= ~(1u << bit);
+                size_t i = w * 32 + bit;
+                particles.enqueue(playerBullets.x[i], playerBullets.y[i], SPARK_STYLE);
+                playerBullets.removeAt(i);
+                damageEnemy(enemy);
             }
-            else ++it;
         }
     }
 
     // Enemy bullet collision with player
     if (isPlayerAlive) {
-        for (auto it = bullets.begin(); it != bullets.end();) {
-            if (!it->isFromPlayer) {
-                if (rectCollision(it->x, it->y, BULLET_SIZE, playerX, playerY, playerSize)) {
-                    playerLives--;
-                    isPlayerAlive = false;
-                    respawnTimer = RESPAWN_FRAMES;
-                    it = bullets.erase(it);
-                    if (playerLives <= 0) {
-                        isGameOver = true;
-                    }
-                    else
-                    {
-                        shakeTimer = 15; // Shake for 5 frames
-                    }
+        enemyBullets.ensurePositions(simTick);
+        updatePlayerHitbox();
+        enemySweep.update(enemyBullets);
+        int grazes = countGrazes();
+        grazeCount += grazes;
+        garbageCharge += grazes;
+        int hit = findPlayerHit();
+        if (hit >= 0) {
+            enemyBullets.removeAt(hit);
+            killPlayer();
+        }
+    }
+}
+
+// Beams follow their owner (the ship's nose for the player), then sweep and expire
+void updateBeams() {
+    TICK_PHASE(PHASE_BEAMS);
+    beams.removeIf([](Beam& beam) {
+        if (beam.owner) {
+            Enemy* enemy = enemies.get(beam.owner);
+            if (!enemy || !enemy->isAlive) return true;
+            beam.x = enemy->x; beam.y = enemy->y;
+        }
+        else {
+            beam.x = playerX;
+            beam.y = playerY + 0.2f * playerSize;
+        }
+        if (beam.warmup > 0) { beam.warmup--; return false; }
+        beam.angle += beam.sweep;
+        if (beam.ticksLeft > 0) beam.ticksLeft--;
+        return beam.ticksLeft == 0;
+    });
+}
+
+void handleBeamCollisions() {
+    TICK_PHASE(PHASE_BEAM_COLLISIONS);
+    if (beams.empty()) return;
+    enemyBullets.ensurePositions(simTick);
+    if (isPlayerAlive) updatePlayerHitbox();
+
+    bool playerHit = false;
+    for (auto& beam : beams) {
+        if (beam.warmup > 0) continue;
+        float bx, by;
+        beamEnd(beam, bx, by);
+
+        if (beam.flags & BEAM_CANCELS_BULLETS) {
+            hitMask.resize((enemyBullets.size() + 31) / 32);
+            size_t hits = capsuleCollisionMask(enemyBullets.x.data(), enemyBullets.y.data(), enemyBullets.size(),
+                beam.x, beam.y, bx, by, beam.radius + tuning.bulletSize, hitMask.data());
+            for (size_t w = hitMask.size(); hits > 0 && w-- > 0;) {
+                uint32_t bits = hitMask[w];
+                while (bits) {
+                    int bit = highestBit(bits);
+                    bits &= ~(1u << bit);
+                    size_t i = w * 32 + bit;
+                    particles.enqueue(enemyBullets.x[i], enemyBullets.y[i], CANCEL_STYLE);
+                    enemyBullets.removeAt(i);
+                }
+            }
+        }
+
+        // A beam hits each enemy it touches at most once per damage interval
+        if (beam.flags & BEAM_HITS_ENEMIES) {
+            if (beam.damageTimer > 0) beam.damageTimer--;
+            else {
+                for (auto& enemy : enemies) {
+                    if (!enemy.isAlive) continue;
+                    float half = enemy.size / 2;
+                    if (!capsuleHitsBox(beam.x, beam.y, bx, by, beam.radius, enemy.x, enemy.y, half, half)) continue;
+                    particles.enqueue(enemy.x, enemy.y, SPARK_STYLE);
+                    damageEnemy(enemy);
+                    beam.damageTimer = tuning.laserDamageInterval;
+                }
+            }
+        }
+
+        if ((beam.flags & BEAM_HITS_PLAYER) && isPlayerAlive && capsuleHitsPlayer(beam.x, beam.y, bx, by, beam.radius)) {
+            playerHit = true;
+        }
+    }
+
+    // After the loop: killing the player removes its beam
+    if (playerHit) killPlayer();
+}
+
+// Scripted player for soak tests (--bot, --headless). Produces the same input frames
+// as the keyboard: fires continuously and each tick moves whichever of the nine
+// directions is least dangerous a few ticks ahead. Danger comes from the enemy
+// bullets near the ship, gathered once per tick through the collision sweep and
+// evaluated on their own trajectories at each lookahead tick, and from enemy
+// lasers, carried along with their owner and swept ahead the same way. A seeded
+// jitter breaks ties, so a seed replays the same game.
+const int BOT_LOOKAHEAD[] = { 1, 2, 3, 4, 6, 8 }; // Ticks ahead each move is scored at; dense enough that bullets can't slip between
+const int BOT_STEPS = sizeof(BOT_LOOKAHEAD) / sizeof(BOT_LOOKAHEAD[0]);
+const float BOT_MAX_BULLET_SPEED = 0.05f; // Per tick, bounds the gather window
+const float BOT_MARGIN = 0.06f;           // Clearance wanted beyond the ship's bounds
+const float BOT_HIT_PENALTY = 50.0f;      // Per bullet overlapping the ship's bounds
+const float BOT_HOME_WEIGHT = 0.5f;       // Pull toward the firing position
+
+class ScriptedBot {
+public:
+    bool active = false;
+
+    void seed(uint64_t value) { rng.seed(value, RNG_BOT); }
+
+    InputFrame think() {
+        TRACE_SCOPE("bot");
+        InputFrame input;
+        input.buttons = INPUT_FIRE;
+        if (!isPlayerAlive) return input;
+
+        // The sweep is only kept while the ship is alive; catch up after a respawn
+        if (enemySweep.positionTick != simTick) {
+            enemyBullets.ensurePositions(simTick);
+            enemySweep.update(enemyBullets);
+        }
+
+        const int maxLookahead = BOT_LOOKAHEAD[BOT_STEPS - 1];
+        updatePlayerHitbox();
+        const float hit = std::max(playerHitbox.halfW, playerHitbox.halfH) + tuning.bulletSize;
+        const float reach = hit + BOT_MARGIN;
+        gather(reach + (tuning.moveSpeed + BOT_MAX_BULLET_SPEED) * maxLookahead);
+        gatherBeams();
+
+        // Line up under the lowest enemy, back off toward the bottom
+        float homeX = 0.0f, homeY = -0.6f, lowest = 2.0f;
+        for (const Enemy& e : enemies) {
+            if (e.isAlive && std::abs(e.x) < 1.0f && e.y > -0.2f && e.y < lowest) { lowest = e.y; homeX = e.x; }
+        }
+
+        int best = 0;
+        float bestScore = 1e30f;
+        for (int dir = 0; dir < 9; ++dir) {
+            float dx = (float)(dir % 3 - 1), dy = (float)(dir / 3 - 1);
+            float len = std::sqrt(dx * dx + dy * dy);
+            if (len > 0.0f) { dx /= len; dy /= len; }
+
+            float score = 0.0f;
+            for (int step = 0; step < BOT_STEPS; ++step) {
+                float px = std::min(std::max(playerX + dx * tuning.moveSpeed * BOT_LOOKAHEAD[step], -0.95f), 0.95f);
+                float py = std::min(std::max(playerY + dy * tuning.moveSpeed * BOT_LOOKAHEAD[step], -0.92f), 0.92f);
+                score += danger(step, px, py, hit, reach);
+                if (step == BOT_STEPS - 1) score += BOT_HOME_WEIGHT * ((px - homeX) * (px - homeX) + (py - homeY) * (py - homeY));
+            }
+            if (dir == lastDir) score -= 0.01f;  // Don't dither between equals
+            score += 0.001f * rng.uniform();
+            if (score < bestScore) { bestScore = score; best = dir; }
+        }
+        lastDir = best;
+
+        if (best % 3 == 0) input.buttons |= INPUT_LEFT;
+        if (best % 3 == 2) input.buttons |= INPUT_RIGHT;
+        if (best / 3 == 0) input.buttons |= INPUT_DOWN;
+        if (best / 3 == 2) input.buttons |= INPUT_UP;
+        return input;
+    }
+
+private:
+    struct Capsule { float ax, ay, bx, by, r; };
+
+    Rng rng{ RNG_BOT };
+    int lastDir = 4; // Standing still
+    std::vector<float> futureX[BOT_STEPS], futureY[BOT_STEPS]; // Nearby bullets at each lookahead
+    std::vector<Capsule> futureBeams[BOT_STEPS];                // Enemy lasers that can hit at each lookahead
+
+    // Enemy bullets within window of the ship, where they will be at each lookahead tick
+    void gather(float window) {
+        for (int step = 0; step < BOT_STEPS; ++step) { futureX[step].clear(); futureY[step].clear(); }
+        const auto& entries = enemySweep.entries;
+        const uint32_t last = sweepKey(playerX + window);
+        for (size_t k = enemySweep.lowerBound(playerX - window); k < entries.size() && entries[k].key <= last; ++k) {
+            uint32_t d = entries[k].dense;
+            if (std::abs(enemyBullets.y[d] - playerY) >= window) continue;
+            for (int step = 0; step < BOT_STEPS; ++step) {
+                float fx, fy;
+                enemyBullets.positionAt(d, simTick + BOT_LOOKAHEAD[step], fx, fy);
+                futureX[step].push_back(fx);
+                futureY[step].push_back(fy);
+            }
+        }
+    }
+
+    // Enemy lasers as updateBeams will leave them: at the owner's position, sweeping
+    // once the warmup is over, gone when their ticks run out
+    void gatherBeams() {
+        for (int step = 0; step < BOT_STEPS; ++step) futureBeams[step].clear();
+        for (const Beam& beam : beams) {
+            if (!(beam.flags & BEAM_HITS_PLAYER) || !beam.owner) continue;
+            const Enemy* owner = enemies.get(beam.owner);
+            if (!owner || !owner->isAlive) continue;
+            for (int step = 0; step < BOT_STEPS; ++step) {
+                const int t = BOT_LOOKAHEAD[step];
+                const int swept = t - beam.warmup; // Updates past the warmup by then
+                if (swept < 0 || (beam.ticksLeft > 0 && swept >= beam.ticksLeft)) continue;
+                Capsule c;
+                c.ax = owner->x + owner->vx * t;
+                c.ay = owner->y + owner->vy * t;
+                float angle = beam.angle + beam.sweep * swept;
+                c.bx = c.ax + std::cos(angle) * beam.length;
+                c.by = c.ay + std::sin(angle) * beam.length;
+                c.r = beam.radius;
+                futureBeams[step].push_back(c);
+            }
+        }
+    }
+
+    // Near misses cost a little, hits a lot
+    float danger(int step, float px, float py, float hit, float reach) const {
+        const float hitSq = hit * hit, reachSq = reach * reach;
+        const float* xs = futureX[step].data();
+        const float* ys = futureY[step].data();
+        float sum = 0.0f;
+        for (size_t i = 0; i < futureX[step].size(); ++i) {
+            float dx = xs[i] - px, dy = ys[i] - py;
+            float distSq = dx * dx + dy * dy;
+            if (distSq < reachSq) sum += 1.0f - distSq / reachSq;
+            if (distSq < hitSq) sum += BOT_HIT_PENALTY;
+        }
+
+        // Lasers: near misses by the distance from the ship's center, hits exactly on
+        // its pieces, moved to (px, py) by moving the capsule the other way
+        const PlayerHitbox& hb = playerHitbox;
+        const float ox = px - playerX, oy = py - playerY;
+        for (const Capsule& c : futureBeams[step]) {
+            float dx = c.bx - c.ax, dy = c.by - c.ay;
+            float lenSq = dx * dx + dy * dy;
+            float beamReach = std::max(hb.halfW, hb.halfH) + c.r + BOT_MARGIN;
+            float distSq = segmentDistSq(hb.centerX + ox - c.ax, hb.centerY + oy - c.ay, dx, dy, lenSq > 0.0f ? 1.0f / lenSq : 0.0f);
+            if (distSq >= beamReach * beamReach) continue;
+            sum += 1.0f - distSq / (beamReach * beamReach);
+            for (const auto& piece : hb.pieces) {
+                if (segmentPolygonDistSq(piece.x, piece.y, piece.count, c.ax - ox, c.ay - oy, c.bx - ox, c.by - oy) < c.r * c.r) {
+                    sum += BOT_HIT_PENALTY;
                     break;
                 }
-                else ++it;
             }
-            else ++it;
         }
+        return sum;
     }
+
+};
+
+ScriptedBot bot;
+
+// Local keyboard as an input frame
+InputFrame readKeyboard() {
+    InputFrame input;
+    if (keyState['w']) input.buttons |= INPUT_UP;
+    if (keyState['s']) input.buttons |= INPUT_DOWN;
+    if (keyState['a']) input.buttons |= INPUT_LEFT;
+    if (keyState['d']) input.buttons |= INPUT_RIGHT;
+    if (keyState[' ']) input.buttons |= INPUT_FIRE;
+    if (keyState['l'] || keyState['L']) input.buttons |= INPUT_LASER;
+    return input;
+}
+
+// This tick's local input, from the keyboard or the bot. In versus it also sends
+// whatever garbage is charged.
+InputFrame localInput() {
+    InputFrame input = bot.active ? bot.think() : readKeyboard();
+    if (versus.active()) input.garbage = (uint8_t)std::min(std::max(garbageCharge, 0) / GARBAGE_COST, 255);
+    return input;
 }
 
-void processInput() {
+void processInput(const InputFrame& input) {
+    TICK_PHASE(PHASE_INPUT);
     if (isGameOver) return;
     if (!isPlayerAlive) return;
 
     float dx = 0.0f, dy = 0.0f;
-    if (keyState['w']) dy += 1.0f;
-    if (keyState['s']) dy -= 1.0f;
-    if (keyState['a']) dx -= 1.0f;
-    if (keyState['d']) dx += 1.0f;
+    if (input.buttons & INPUT_UP) dy += 1.0f;
+    if (input.buttons & INPUT_DOWN) dy -= 1.0f;
+    if (input.buttons & INPUT_LEFT) dx -= 1.0f;
+    if (input.buttons & INPUT_RIGHT) dx += 1.0f;
 
     if (dx != 0.0f || dy != 0.0f) {
         float len = std::sqrt(dx * dx + dy * dy);
         dx /= len; dy /= len;
-        float newX = playerX + dx * moveSpeed;
-        float newY = playerY + dy * moveSpeed;
+        float newX = playerX + dx * tuning.moveSpeed;
+        float newY = playerY + dy * tuning.moveSpeed;
         // Limit player within widndow boundary
         if (newX - 0.1f * playerSize > -1.0f && newX + 0.1f * playerSize < 1.0f) playerX = newX;
         if (newY - 0.2f * playerSize > -1.0f && newY + 0.2f * playerSize < 1.0f) playerY = newY;
@@ -401,35 +5880,62 @@ void processInput() {
 
     // Player bullet shooting
     if (playerFireCooldown > 0) playerFireCooldown--;
-    if (keyState[' '] && playerFireCooldown == 0) {
+    if ((input.buttons & INPUT_FIRE) && playerFireCooldown == 0) {
         Bullet b;
-        b.isFromPlayer = true;
         b.x = playerX;
         b.y = playerY + (playerSize + 0.01f);
         b.vx = 0.0f;
         b.vy = 1.0f;
-        b.speed = 0.08f;
-        bullets.push_back(b);
-        playerFireCooldown = playerFireCooldownMax;
+        b.speed = tuning.playerBulletSpeed;
+        playerBullets.insert(b);
+        playerFireCooldown = tuning.playerFireCooldownMax;
+    }
+
+    // Player laser, held while L is down
+    bool laserHeld = (input.buttons & INPUT_LASER) != 0;
+    if (laserHeld && !beams.contains(playerBeam)) {
+        playerBeam = fireBeam(playerX, playerY + 0.2f * playerSize, PI / 2, 0.0f, tuning.laserWidth, 0, -1,
+            BEAM_HITS_ENEMIES | BEAM_CANCELS_BULLETS, INVALID_HANDLE);
     }
+    else if (!laserHeld) beams.remove(playerBeam);
 }
 
-void timer(int value) {
+// One tick of the game. Reads nothing but its inputs and the simulation state, so
+// the rollback session can replay it. opponent carries versus garbage.
+void simulateTick(const InputFrame& input, const InputFrame& opponent) {
+    TRACE_SCOPE("simulateTick");
     if (!isGameOver) {
-        processInput();
+        garbageCharge -= input.garbage * GARBAGE_COST;
+        processInput(input);
+        spawnGarbage(opponent.garbage);
 
-        // Enemy bullet shooting considering cooldown
-        if (enemy.isAlive) {
-            if (enemy.shootCooldown > 0) enemy.shootCooldown--;
-            else {
-                spawnEnemyBullet();
-                enemy.shootCooldown = ENEMY_SHOOT_COOLDOWN;
+        updateStage();
+
+        // Enemy movement and shooting: scripted pattern, or a single aimed shot considering cooldown
+        {
+            TICK_PHASE(PHASE_ENEMIES);
+            for (auto& enemy : enemies) {
+                if (!enemy.isAlive) continue;
+                enemy.x += enemy.vx;
+                enemy.y += enemy.vy;
+                if (enemy.pattern.pattern >= 0) runPattern(enemy);
+                else if (enemy.shootCooldown > 0) enemy.shootCooldown--;
+                else {
+                    spawnEnemyBullet(enemy);
+                    enemy.shootCooldown = enemy.shootInterval;
+                }
             }
         }
 
-        // Bullet handling
+        // Bullet and laser handling
         updateBullets();
+        updateBeams();
+        handleBeamCollisions();
         handleCollisions();
+        recordTrails();
+
+        // Dead enemies, and stage enemies that flew off the field
+        enemies.removeIf([](const Enemy& e) { return !e.isAlive || std::abs(e.x) > 1.5f || std::abs(e.y) > 1.5f; });
 
         // Player respawn
         if (!isPlayerAlive && !isGameOver) {
@@ -445,26 +5951,508 @@ void timer(int value) {
                 }
             }
         }
+        decayTrauma();
+    }
+
+    finishCounterTick();
+}
+
+// Advances the game by the ticks the pacer says are due; zero on a fast display
+// between ticks, more than one to catch up after a late frame
+void runTicks(int ticks) {
+    TRACE_SCOPE("timer");
+    applyTuningChanges();
+
+    for (int i = 0; i < ticks; ++i) {
+        if (versus.active()) versus.advance(localInput());
+        else if (!isGameOver) {
+            simulateTick(localInput(), InputFrame());
+            snapshots.push();
+            logStateHash();
+        }
+        else decayTrauma();
+
+        // Effects keep playing out after the game ends
+        particles.update();
+    }
+}
+
+// Without vsync: wakes for each tick against absolute deadlines
+void timer(int value) {
+    runTicks(wallClockTicks());
+    glutPostRedisplay();
+    glutTimerFunc(msUntilNextTick(), timer, 0);
+}
+
+// With vsync: one pass per present, since the swap blocks. While nothing is being
+// presented (hidden window) the game keeps time by the clock
+void paceFrame() {
+    int ticks;
+    if (pacer.presented) ticks = pacer.ticksDue;
+    else if (presentStalled()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ticks = wallClockTicks();
     }
+    else {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        return;
+    }
+    pacer.presented = false;
 
+    // Calibration found the driver ignoring the swap interval
+    if (pacer.mode == PACE_TIMER) {
+        glutIdleFunc(nullptr);
+        glutTimerFunc(0, timer, 0);
+        return;
+    }
+    runTicks(ticks);
     glutPostRedisplay();
-    glutTimerFunc(16, timer, 0); // 60 FPS
+}
+
+// Slow bullets spread over the field, to hold the count through a benchmark run
+void spawnBenchBullets(int bulletCount) {
+    size_t first = enemyBullets.insertBatch(bulletCount);
+    size_t count = enemyBullets.size() - first; // Fewer past the pool's limit
+    for (size_t j = first; j < enemyBullets.size(); ++j) {
+        float t = (float)(j - first) / count;
+        enemyBullets.x0[j] = std::fmod(t * 97.0f, 1.8f) - 0.9f;
+        enemyBullets.y0[j] = std::fmod(t * 13.0f, 1.0f) - 0.1f;
+        enemyBullets.vx[j] = 0.0001f * std::cos(t * 400.0f);
+        enemyBullets.vy[j] = -0.0001f;
+        enemyBullets.kind[j] = (j & 3) == 0 ? TRAJ_SINE : TRAJ_LINEAR;
+        enemyBullets.params[j] = TrajectoryParams();
+        enemyBullets.params[j].a = 0.05f;
+        enemyBullets.params[j].b = 0.05f;
+    }
+    enemyBullets.finishBatch(first, count);
+}
+
+// --rollback-bench: worst-case rollback cost, headless. Two sessions over a loopback
+// transport, each with its own field swapped in and out through snapshots. The
+// opponent sends garbage every tick and its input arrives ROLLBACK_MAX_TICKS frames
+// late, so every frame re-simulates the whole window before running its own tick.
+// The field holds at most ROLLBACK_MAX_BULLETS enemy bullets, as in versus.
+// The bot flies the ship with lives to spare: frames where it is alive pay for the
+// sweep and the hit tests, and those are held against the frame budget. Afterwards
+// the local field is replayed from its confirmed inputs without rollback and has
+// to match the session's state bit for bit.
+int runRollbackBench(int bulletCount) {
+    const int frames = 600;
+    const double budget = TICK_SECONDS * 1e6;
+    enemyBullets.limit = ROLLBACK_MAX_BULLETS;
+    spawnBenchBullets(bulletCount);
+    playerLives = 1 << 20;
+
+    std::vector<uint8_t> start, fieldA, fieldB, replay;
+    saveSnapshot(start);
+    fieldB = start;
+
+    LoopbackTransport linkA, linkB;
+    LoopbackTransport::connect(linkA, linkB);
+    linkA.latency = linkB.latency = ROLLBACK_MAX_TICKS;
+    RollbackSession a, b;
+    a.start(&linkA, simulateTick);
+    b.start(&linkB, simulateTick);
+
+    std::vector<InputFrame> localLog, remoteLog;
+    std::vector<double> times, aliveTimes;
+    double worst = 0.0;
+    int worstDepth = 0;
+    long long resimulated = 0;
+    for (int f = 0; f < frames; ++f) {
+        linkA.tick();
+        linkB.tick();
+
+        // The opponent only sends garbage
+        InputFrame inputA = bot.think(), inputB;
+        inputB.garbage = 1;
+
+        bool alive = isPlayerAlive;
+        int before = a.currentFrame();
+        auto t0 = std::chrono::steady_clock::now();
+        a.advance(inputA);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        times.push_back(us);
+        if (alive && isPlayerAlive) aliveTimes.push_back(us);
+        resimulated += a.lastRollback;
+        if (us > worst) { worst = us; worstDepth = a.lastRollback; }
+        if (a.currentFrame() > before) localLog.push_back(inputA);
+        while ((int)remoteLog.size() <= a.confirmedFrame()) remoteLog.push_back(a.remoteInput((int)remoteLog.size()));
+
+        saveSnapshot(fieldA);
+        restoreSnapshot(fieldB);
+        b.advance(inputB);
+        saveSnapshot(fieldB);
+        restoreSnapshot(fieldA);
+    }
+
+    std::sort(times.begin(), times.end());
+    std::sort(aliveTimes.begin(), aliveTimes.end());
+    double total = 0.0;
+    for (double t : times) total += t;
+    int over = (int)(times.end() - std::upper_bound(times.begin(), times.end(), budget));
+    printf("Rollback bench: %zu enemy bullets (limit %zu), latency %d frames, %d frames\n",
+        enemyBullets.size(), enemyBullets.limit, ROLLBACK_MAX_TICKS, frames);
+    printf("  rollbacks %d (max %d ticks), stalls %d, %lld ticks re-simulated\n", a.rollbacks, a.maxRollback, a.stalls, resimulated);
+    printf("  frame: mean %.1f us, p50 %.1f us, p99 %.1f us, worst %.1f us (%d ticks re-simulated)\n",
+        total / frames, times[frames / 2], times[frames * 99 / 100], worst, worstDepth);
+    if (!aliveTimes.empty()) {
+        size_t n = aliveTimes.size();
+        printf("  ship alive, %zu frames: p50 %.1f us, p99 %.1f us, worst %.1f us\n",
+            n, aliveTimes[n / 2], aliveTimes[n * 99 / 100], aliveTimes.back());
+    }
+    printf("  worst frame %.0f%% of the %.1f ms budget, %d frames over\n", 100.0 * worst / budget, budget / 1000.0, over);
+    printf("  per simulated tick: %.1f us\n", total / (frames - a.stalls + resimulated));
+
+    // Replay up to the last confirmed frame and compare with the session's state there
+    int end = std::min(a.confirmedFrame() + 1, a.currentFrame());
+    std::vector<uint8_t> expected = end == a.currentFrame() ? fieldA : a.savedState(end);
+    restoreSnapshot(start);
+    for (int f = 0; f < end; ++f) simulateTick(localLog[f], remoteLog[f]);
+    saveSnapshot(replay);
+    bool same = replay == expected;
+    printf("  replay of %d confirmed frames %s\n", end, same ? "matches" : "DIFFERS");
+    return same ? 0 : 1;
+}
+
+// --sweep-bench: the enemy bullet sweep and the graze and hit queries on it, headless.
+// The --rollback-bench bullets with the ship parked among them; each tick a few
+// bullets die and new ones spawn at random, as a busy pattern would. Times the
+// sweep update and the queries apart; the update should stay well under 1 ms.
+int runSweepBench(int bulletCount) {
+    const int ticks = 600;
+    const int churn = 64;
+    spawnBenchBullets(bulletCount);
+    playerX = 0.0f; playerY = 0.3f;
+    updatePlayerHitbox();
+
+    Rng rng;
+    std::vector<double> updateTimes, queryTimes;
+    int grazes = 0;
+    for (int t = 0; t < ticks; ++t) {
+        simTick++;
+        for (int k = 0; k < churn && enemyBullets.size() > 0; ++k) enemyBullets.removeAt(rng.next() % enemyBullets.size());
+        size_t first = enemyBullets.insertBatch(churn);
+        for (size_t j = first; j < enemyBullets.size(); ++j) {
+            enemyBullets.x0[j] = rng.linearRand(-0.9f, 0.9f);
+            enemyBullets.y0[j] = rng.linearRand(-0.1f, 0.9f);
+            enemyBullets.vx[j] = rng.linearRand(-0.01f, 0.01f);
+            enemyBullets.vy[j] = rng.linearRand(-0.01f, 0.0f);
+            enemyBullets.kind[j] = TRAJ_LINEAR;
+            enemyBullets.params[j] = TrajectoryParams();
+        }
+        enemyBullets.finishBatch(first, enemyBullets.size() - first);
+        enemyBullets.ensurePositions(simTick);
+
+        auto t0 = std::chrono::steady_clock::now();
+        enemySweep.update(enemyBullets);
+        auto t1 = std::chrono::steady_clock::now();
+        grazes += countGrazes();
+        findPlayerHit();
+        auto t2 = std::chrono::steady_clock::now();
+        updateTimes.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        queryTimes.push_back(std::chrono::duration<double, std::micro>(t2 - t1).count());
+    }
+
+    auto report = [](const char* what, std::vector<double>& times) {
+        std::sort(times.begin(), times.end());
+        double total = 0.0;
+        for (double t : times) total += t;
+        printf("  %s: mean %.1f us, p50 %.1f us, p99 %.1f us, worst %.1f us\n", what,
+            total / times.size(), times[times.size() / 2], times[times.size() * 99 / 100], times.back());
+    };
+    printf("Sweep bench: %zu enemy bullets, %d ticks, %d spawned and removed per tick\n", enemyBullets.size(), ticks, churn);
+    report("update", updateTimes);
+    report("graze and hit queries", queryTimes);
+    printf("  %d grazes\n", grazes);
+    return 0;
+}
+
+// Enemy setup, shared by main and reset. A stage spawns from its table as it runs
+void spawnEnemies() {
+    enemies.clear();
+    bossHandle = INVALID_HANDLE;
+    stageStartTick = simTick;
+    stageCursor = 0;
+    if (stage.loaded()) return;
+
+    Enemy enemy = Enemy();
+    enemy.x = tuning.enemyX;
+    enemy.y = tuning.enemyY;
+    enemy.vx = 0.0f;
+    enemy.vy = 0.0f;
+    enemy.size = tuning.enemySize;
+    enemy.health = tuning.enemyHealth;
+    enemy.maxHealth = tuning.enemyHealth;
+    enemy.shootCooldown = tuning.enemyFirstShotDelay;
+    enemy.shootInterval = tuning.enemyShootCooldown;
+    enemy.isAlive = true;
+    startPattern(enemy.pattern, findPattern("boss"));
+    bossHandle = enemies.insert(enemy);
+}
+
+// Back to the start with full lives, shared by R and the headless run
+void resetGame() {
+    playerLives = 5;
+    isPlayerAlive = true;
+    isGameOver = false;
+    playerX = 0.0f; playerY = -0.6f;
+    spawnEnemies();
+    playerBullets.clear();
+    enemyBullets.clear();
+    beams.clear();
+    particles.clear();
+    trails.clear();
+    grazeCount = 0;
+    shakeTrauma = 0.0f;
+    patternRng.seed(rngSeed, RNG_PATTERNS);
+    snapshots.clear();
+}
+
+// --headless: the bot plays unattended, restarting whenever the game ends or the
+// stage is cleared. Reports tick times (simulation and particles, no rendering)
+// from a histogram of 0.1 us buckets, so millions of ticks take no extra memory.
+int runHeadless(long long ticks) {
+    const int bucketCount = 100000; // Up to 10 ms
+    std::vector<uint32_t> histogram(bucketCount);
+    size_t peakBullets = 0, peakEnemies = 0;
+    long long deaths = 0, gameOvers = 0, clears = 0;
+    double total = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long long t = 1; t <= ticks; ++t) {
+        int lives = playerLives;
+        auto t0 = std::chrono::steady_clock::now();
+        simulateTick(bot.think(), InputFrame());
+        particles.update();
+        logStateHash();
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+
+        total += us;
+        histogram[std::min((int)(us * 10.0), bucketCount - 1)]++;
+        peakBullets = std::max(peakBullets, enemyBullets.size() + playerBullets.size());
+        peakEnemies = std::max(peakEnemies, enemies.size());
+        deaths += lives - playerLives;
+        if (isGameOver || stageCleared()) {
+            if (isGameOver) gameOvers++;
+            else clears++;
+            resetGame();
+        }
+        if (t % 1000000 == 0) printf("Headless: %lld ticks, %lld deaths\n", t, deaths);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto percentile = [&](double p) {
+        long long target = (long long)std::ceil(p * ticks), seen = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            seen += histogram[i];
+            if (seen >= target) return i / 10.0;
+        }
+        return bucketCount / 10.0;
+    };
+    printf("Headless: %lld ticks in %.1f s (%.0f ticks/s)\n", ticks, seconds, ticks / seconds);
+    printf("  tick: mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %s%.1f us\n",
+        total / ticks, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+        histogram[bucketCount - 1] ? ">" : "", percentile(1.0));
+    printf("  peak bullets %zu, peak enemies %zu\n", peakBullets, peakEnemies);
+    printf("  deaths %lld, game overs %lld, stages cleared %lld\n", deaths, gameOvers, clears);
+    return 0;
+}
+
+// --verify-backends: the scalar reference kernels and the SIMD ones play the same
+// game in lockstep, each field swapped in and out through snapshots. The bot reads
+// the reference field and both get its input. Stops at the first tick whose state
+// hashes disagree and names the first entity that differs.
+int runBackendCheck(long long ticks) {
+    particles.muted = true;
+    resetGame();
+    std::vector<uint8_t> reference, optimized;
+    saveSnapshot(reference);
+    optimized = reference;
+
+    SnapshotGlobals g;
+    Rng refRng;
+    SlotMap<Enemy> refEnemies;
+    SlotMap<Beam> refBeams;
+    BulletPool refPlayer, refEnemy;
+    for (long long t = 1; t <= ticks; ++t) {
+        restoreSnapshot(reference);
+        simdKernels = false;
+        InputFrame input = bot.think();
+        simulateTick(input, InputFrame());
+        bool restart = isGameOver || stageCleared();
+        uint64_t expected = hashState();
+        saveSnapshot(reference);
+
+        restoreSnapshot(optimized);
+        simdKernels = true;
+        simulateTick(input, InputFrame());
+        uint64_t actual = hashState();
+        saveSnapshot(optimized);
+
+        if (actual != expected) {
+            printf("Backends: diverged at tick %d (%lld ticks in), scalar %016llx, SIMD %016llx\n",
+                simTick, t, (unsigned long long)expected, (unsigned long long)actual);
+            restoreSnapshot(reference);
+            g = captureGlobals();
+            refRng = patternRng;
+            refEnemies = enemies; refBeams = beams; refPlayer = playerBullets; refEnemy = enemyBullets;
+            restoreSnapshot(optimized);
+            if (!reportDivergence(g, refRng, refEnemies, refBeams, refPlayer, refEnemy)) printf("  slot index bookkeeping only\n");
+            return 1;
+        }
+
+        // Both restart together; resetGame is deterministic
+        if (restart) {
+            resetGame();
+            saveSnapshot(reference);
+            optimized = reference;
+        }
+        if (t % 100000 == 0) printf("Backends: %lld ticks agree\n", t);
+    }
+    printf("Backends: scalar and SIMD agree on all %lld ticks\n", ticks);
+    return 0;
+}
+
+// --self-test: the batched collision kernels against the scalar tests they stand in
+// for. Random boxes plus the edges where a rewrite would slip: bullets exactly a half
+// extent away and one ulp either side, signed zeros, infinities and NaNs, in every
+// lane position and in the scalar tail. Both the SIMD path this build was compiled
+// for and the scalar one; fails on the first bit that differs.
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+const char* SIMD_KERNEL_NAME = "AVX2";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+const char* SIMD_KERNEL_NAME = "SSE2";
+#else
+const char* SIMD_KERNEL_NAME = "scalar";
+#endif
+
+bool checkRectCollisionMask(const std::vector<float>& xs, const std::vector<float>& ys, float s1, float x2, float y2, float s2) {
+    size_t n = xs.size();
+    std::vector<uint32_t> hits((n + 31) / 32 + 1, 0xFFFFFFFFu);
+    size_t count = rectCollisionMask(xs.data(), ys.data(), n, s1, x2, y2, s2, hits.data());
+    size_t expected = 0;
+    for (size_t j = 0; j < n; ++j) {
+        bool want = rectCollision(xs[j], ys[j], s1, x2, y2, s2);
+        bool got = (hits[j / 32] >> (j % 32)) & 1;
+        expected += want;
+        if (got != want) {
+            printf("Self-test: %s collision mask bit %zu of %zu is %d, rectCollision says %d\n",
+                simdKernels ? SIMD_KERNEL_NAME : "scalar", j, n, got, want);
+            printf("  bullet (%a, %a) size %a, box (%a, %a) size %a\n", xs[j], ys[j], s1, x2, y2, s2);
+            return false;
+        }
+    }
+    // Bits past n in the last word stay clear, the word after it untouched
+    uint32_t tail = n % 32 ? hits[n / 32] >> (n % 32) : 0;
+    if (count != expected || tail || hits[(n + 31) / 32] != 0xFFFFFFFFu) {
+        printf("Self-test: %s collision mask over %zu bullets counts %zu, expected %zu%s\n",
+            simdKernels ? SIMD_KERNEL_NAME : "scalar", n, count, expected, tail ? ", stray bits past the end" : "");
+        return false;
+    }
+    return true;
+}
+
+int runSelfTest() {
+    const float inf = INFINITY, nan = NAN;
+    // Offsets from the box center with s1 + s2 = 0.375: every sum below is exact
+    const float half = 0.1875f;
+    const float offsets[] = {
+        0.0f, -0.0f, half, -half,
+        std::nextafter(half, 0.0f), std::nextafter(half, 1.0f), -std::nextafter(half, 0.0f), -std::nextafter(half, 1.0f),
+        1e-45f, 3.0f, FLT_MAX, -FLT_MAX, inf, -inf, nan, -nan,
+    };
+    const size_t offsetCount = sizeof(offsets) / sizeof(offsets[0]);
+    const float centers[][2] = { { 0.0f, 0.0f }, { -0.0f, -0.0f }, { 0.25f, -0.5f }, { -1.0f, 0.75f } };
+    const float sizes[][2] = { { 0.125f, 0.25f }, { 0.0f, 0.0f }, { 0.0f, inf }, { 0.125f, nan }, { -0.25f, 0.125f } };
+    const float oddCenters[][2] = { { inf, 0.0f }, { 0.0f, -inf }, { nan, 0.0f }, { 0.0f, nan } };
+
+    Rng rng;
+    bool ok = true;
+    long long cases = 0;
+    for (int pass = 0; pass < 2 && ok; ++pass) {
+        simdKernels = pass == 0;
+
+        // Every pair of edge offsets, shifted so each lands in every lane and in the tail
+        for (size_t pad = 0; pad < 32 && ok; pad += 5) {
+            for (const auto& c : centers) {
+                std::vector<float> xs(pad, 0.5f), ys(pad, 0.5f);
+                for (size_t a = 0; a < offsetCount; ++a) {
+                    for (size_t b = 0; b < offsetCount; ++b) {
+                        xs.push_back(c[0] + offsets[a]);
+                        ys.push_back(c[1] + offsets[b]);
+                    }
+                }
+                ok = ok && checkRectCollisionMask(xs, ys, 0.125f, c[0], c[1], 0.25f);
+                for (const auto& sz : sizes) ok = ok && checkRectCollisionMask(xs, ys, sz[0], c[0], c[1], sz[1]);
+                for (const auto& o : oddCenters) ok = ok && checkRectCollisionMask(xs, ys, 0.125f, o[0], o[1], 0.25f);
+                cases += 1 + (long long)(sizeof(sizes) / sizeof(sizes[0]) + sizeof(oddCenters) / sizeof(oddCenters[0]));
+            }
+        }
+
+        // Random boxes over random bullets, with a few placed right on the edge
+        for (int trial = 0; trial < 2000 && ok; ++trial) {
+            size_t n = rng.next() % 300;
+            float x2 = rng.linearRand(-1.0f, 1.0f), y2 = rng.linearRand(-1.0f, 1.0f);
+            float s1 = rng.linearRand(0.0f, 0.2f), s2 = rng.linearRand(0.0f, 0.2f);
+            float h = (s1 + s2) / 2;
+            std::vector<float> xs(n), ys(n);
+            for (size_t j = 0; j < n; ++j) {
+                xs[j] = x2 + rng.linearRand(-2.0f, 2.0f) * h;
+                ys[j] = y2 + rng.linearRand(-2.0f, 2.0f) * h;
+                if (j % 7 == 0) xs[j] = x2 + (j % 2 ? h : -h);
+                if (j % 11 == 0) ys[j] = std::nextafter(y2 + h, j % 2 ? inf : -inf);
+            }
+            ok = checkRectCollisionMask(xs, ys, s1, x2, y2, s2);
+            ++cases;
+        }
+    }
+    simdKernels = true;
+
+    if (!ok) return 1;
+    printf("Self-test: %s and scalar collision masks match rectCollision on %lld cases\n", SIMD_KERNEL_NAME, cases);
+    return 0;
 }
 
 // Handle key input
 void handleKeyDown(unsigned char key, int x, int y) {
     keyState[key] = true;
 
-    // Reset condition
-    if ((key == 'r' || key == 'R')) {
-        playerLives = 5;
-        isPlayerAlive = true;
-        isGameOver = false;
-        playerX = 0.0f; playerY = -0.6f;
-        enemy.isAlive = true;
-        enemy.health = 10;
-        bullets.clear();
+    // Reset condition; in versus the state only moves through the session
+    if ((key == 'r' || key == 'R') && !versus.active()) resetGame();
+
+    // Toggle frame capture
+    if (key == 'c' || key == 'C') {
+        if (capture.active) stopCapture();
+        else startCapture("capture.y4m");
+    }
+
+    // Checkpoint: K saves, J retries from it. Z rewinds one second. Not in versus
+    if (!versus.active()) {
+        if (key == 'k' || key == 'K') {
+            saveSnapshot(checkpoint);
+            printf("Checkpoint: saved at tick %d (%d bytes)\n", simTick, (int)checkpoint.size());
+        }
+        if ((key == 'j' || key == 'J') && !checkpoint.empty() && restoreSnapshot(checkpoint)) {
+            snapshots.discardAfter(simTick);
+        }
+        if (key == 'z' || key == 'Z') rewindTicks(60);
+    }
+
+    // Cycle bloom quality
+    if (key == 'b' || key == 'B') {
+        bloom.quality = (bloom.quality + 1) % BLOOM_QUALITY_COUNT;
+        printf("Bloom: %s\n", bloomQualities[bloom.quality].name);
+    }
+
+    // Print GPU pass timings and frame intervals
+    if (key == 'p' || key == 'P') {
+        printGpuProfile();
+        printFramePacing();
     }
+
+    // Start a trace, or stop and write it
+    if (key == 't' || key == 'T') toggleTrace();
 }
 
 void handleKeyUp(unsigned char key, int x, int y) {
@@ -472,18 +6460,98 @@ void handleKeyUp(unsigned char key, int x, int y) {
 }
 
 int main(int argc, char** argv) {
+    // Command line options
+    std::string capturePath;
+    std::string versusPeer;
+    int versusPort = 0;
+    int rollbackBench = -1;
+    int sweepBench = -1;
+    long long headlessTicks = 0;
+    long long verifyTicks = 0;
+    bool selfTest = false;
+    bool traceAtStart = false;
+    uint64_t botSeed = 0;
+    bool botSeeded = false;
+    std::string countersPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--capture" && i + 1 < argc) capturePath = argv[++i];
+        else if (arg == "--tuning" && i + 1 < argc) tuningPath = argv[++i];
+        else if (arg == "--patterns" && i + 1 < argc) patternPath = argv[++i];
+        else if (arg == "--bloom" && i + 1 < argc) bloom.quality = std::min(std::max(atoi(argv[++i]), 0), BLOOM_QUALITY_COUNT - 1);
+        else if (arg == "--versus" && i + 2 < argc) { versusPort = atoi(argv[++i]); versusPeer = argv[++i]; }
+        else if (arg == "--stage" && i + 1 < argc) stagePath = argv[++i];
+        else if (arg == "--compile-stage" && i + 2 < argc) return compileStage(argv[i + 1], argv[i + 2]) ? 0 : 1;
+        else if (arg == "--hash-log" && i + 1 < argc) {
+            hashLog = fopen(argv[++i], "w");
+            if (!hashLog) printf("Hash log: cannot write %s\n", argv[i]);
+        }
+        else if (arg == "--verify-backends") verifyTicks = i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) ? atoll(argv[++i]) : 100000;
+        else if (arg == "--self-test") selfTest = true;
+        else if (arg == "--counters" && i + 1 < argc) countersPath = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc) { tracePath = argv[++i]; traceAtStart = true; }
+        else if (arg == "--no-vsync") pacer.vsync = false;
+        else if (arg == "--render-scale" && i + 1 < argc) {
+            resolution.scale = std::min(std::max(atoi(argv[++i]), (int)(RENDER_SCALE_MIN * 100)), 100) / 100.0f;
+            resolution.dynamic = false;
+        }
+        else if (arg == "--frame-budget" && i + 1 < argc) resolution.budgetMs = atof(argv[++i]);
+        else if (arg == "--bot") bot.active = true;
+        else if (arg == "--bot-seed" && i + 1 < argc) { botSeed = strtoull(argv[++i], nullptr, 10); botSeeded = true; }
+        else if (arg == "--seed" && i + 1 < argc) rngSeed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--sweep-bench") sweepBench = i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) ? atoi(argv[++i]) : 50000;
+        else if (arg == "--headless") headlessTicks = i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) ? atoll(argv[++i]) : 1000000;
+        else if (arg == "--rollback-bench") rollbackBench = i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) ? atoi(argv[++i]) : (int)ROLLBACK_MAX_BULLETS;
+    }
+
+    // Every stream from the master seed; --bot-seed varies the bot alone
+    shakeRng.seed(rngSeed, RNG_SHAKE);
+    patternRng.seed(rngSeed, RNG_PATTERNS);
+    particles.seed(rngSeed);
+    bot.seed(botSeeded ? botSeed : rngSeed);
+
+    loadTuning();
+    loadPatterns();
+    if (loadStage(stagePath)) bindStagePatterns();
+    playerBullets.reserve(1 << 10);
+    enemyBullets.reserve(1 << 16);
+
     // Player start position
     playerX = 0.0f; playerY = -0.6f;
     playerLives = 5;
     isPlayerAlive = true;
     isGameOver = false;
 
-    enemy.x = 0.0f;
-    enemy.y = 0.6f;
-    enemy.size = 0.09f;
-    enemy.health = 10;
-    enemy.shootCooldown = 30;
-    enemy.isAlive = true;
+    spawnEnemies();
+
+    traceThreadName("main");
+    if (traceAtStart) startTrace();
+    if (!countersPath.empty() && !openPerfCounters(countersPath)) return 1;
+
+    if (selfTest || rollbackBench >= 0 || sweepBench >= 0 || headlessTicks > 0 || verifyTicks > 0) {
+        initializeVA();
+        initPlayerHitbox();
+        int result = selfTest ? runSelfTest()
+            : rollbackBench >= 0 ? runRollbackBench(rollbackBench)
+            : sweepBench >= 0 ? runSweepBench(sweepBench)
+            : verifyTicks > 0 ? runBackendCheck(verifyTicks) : runHeadless(headlessTicks);
+        stopTrace();
+        closePerfCounters();
+        if (hashLog) fclose(hashLog);
+        return result;
+    }
+
+    // Versus: both peers start the session at frame 0 and wait for each other there
+    if (!versusPeer.empty()) {
+        size_t colon = versusPeer.rfind(':');
+        if (colon == std::string::npos || !versusTransport.open(versusPort, versusPeer.substr(0, colon), atoi(versusPeer.c_str() + colon + 1))) {
+            printf("Versus: expected --versus <local port> <host>:<port>\n");
+            return 1;
+        }
+        versus.start(&versusTransport, simulateTick);
+        enemyBullets.limit = ROLLBACK_MAX_BULLETS;
+        printf("Versus: port %d, peer %s\n", versusPort, versusPeer.c_str());
+    }
 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
@@ -491,19 +6559,42 @@ int main(int argc, char** argv) {
     glutCreateWindow("ASSN 1");
 
     glewInit();
+    glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
 
     initializeVA(); // Initialize vertex arrays
+    initPlayerHitbox();
+    initCamera();
+    initBeamRenderer();
+    initParticleRenderer();
+    initTrailRenderer();
+    initBackground();
+    initBloom();
+    initGpuProfiler();
+    initCrc32Table();
 
     glutDisplayFunc(display);
+    glutReshapeFunc(reshape);
     glutKeyboardFunc(handleKeyDown);
     glutKeyboardUpFunc(handleKeyUp);
-    glutTimerFunc(0, timer, 0);
+    if (initFramePacer()) glutIdleFunc(paceFrame);
+    else glutTimerFunc(0, timer, 0);
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     gluOrtho2D(-1, 1, -1, 1);
+    glMatrixMode(GL_MODELVIEW); // Loaded with the camera every frame
+
+    if (!capturePath.empty()) startCapture(capturePath);
 
     glutMainLoop();
+
+    // Window is gone: drop in-flight readbacks, but let the encoder finish queued frames
+    stopCapture(false);
+    printGpuProfile();
+    printFramePacing();
+    stopTrace();
+    closePerfCounters();
+    if (hashLog) fclose(hashLog);
     return 0;
 }
@@ -9,15 +9,17 @@ Enter-VsDevShell -VsInstallPath "C:\Program Files\Microsoft Visual Studio\2022\C
 
 Set-Location $currentDir
 
-cl "$currentDir\assn1.cpp" /EHsc /std:c++17 /D "NDEBUG" `
+cl "$currentDir\assn1.cpp" /EHsc /std:c++17 /O2 /D "NDEBUG" `
 	/I "$currentDir\include" `
 	/Fo"$currentDir\build\assn1.obj" `
 	/Fe"$currentDir\build\build.exe" `
 	/Fd"$currentDir\build\vc.pdb" `
-	/link /LIBPATH:"$currentDir\lib" freeglut.lib glew32.lib opengl32.lib
+	/link /LIBPATH:"$currentDir\lib" freeglut.lib glew32.lib opengl32.lib ws2_32.lib
 
 $env:Path = $env:Path + ";$currentDir\bin"
 
+& "$currentDir\build\build.exe" --compile-stage "$currentDir\stage.txt" "$currentDir\stage.bin"
+
 Write-Host "Execution fild build successfully. Running..."
 & "$currentDir\build\build.exe"
 Write-Host "Execution exited."
\ No newline at end of file